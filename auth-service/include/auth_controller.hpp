@@ -20,11 +20,15 @@ public:
         ADD_METHOD_TO(AuthController::createUser, "/users", drogon::Post);
         ADD_METHOD_TO(AuthController::loginUser, "/users/login", drogon::Post);
         ADD_METHOD_TO(AuthController::refreshToken, "/users/refresh", drogon::Post);
+        ADD_METHOD_TO(AuthController::logoutUser, "/users/logout", drogon::Post, "JwtAuthFilter");
+        ADD_METHOD_TO(AuthController::jwks, "/.well-known/jwks.json", drogon::Get);
     METHOD_LIST_END
 
-    void createUser(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback);
-    void loginUser(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback);
-    void refreshToken(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback);
+    drogon::Task<drogon::HttpResponsePtr> createUser(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> loginUser(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> refreshToken(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> logoutUser(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> jwks(drogon::HttpRequestPtr req);
 
 private:
     redisContext* m_redis;
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <drogon/orm/DbClient.h>
+#include <drogon/utils/coroutine.h>
+
+namespace RefreshTokens
+{
+    constexpr std::chrono::hours lifetime{24};
+
+    // Deletes expired sessions `batchSize` rows per statement until none are left, then calls `done`.
+    drogon::AsyncTask purgeExpired(drogon::orm::DbClientPtr db, size_t batchSize, std::function<void()> done);
+}
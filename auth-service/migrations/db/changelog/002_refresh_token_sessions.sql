@@ -0,0 +1,17 @@
+--changeset danil:4
+DROP TABLE refresh_tokens;
+CREATE TABLE refresh_tokens
+(
+    user_id UUID NOT NULL,
+    session_id UUID NOT NULL,
+    token_hash TEXT NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    expires_at TIMESTAMPTZ NOT NULL,
+    PRIMARY KEY (user_id, session_id),
+    FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE
+);
+--rollback DROP TABLE refresh_tokens; CREATE TABLE refresh_tokens (user_id UUID NOT NULL, token_hash TEXT NOT NULL, FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE);
+
+--changeset danil:5
+CREATE INDEX refresh_tokens_expires_at_idx ON refresh_tokens (expires_at);
+--rollback DROP INDEX refresh_tokens_expires_at_idx;
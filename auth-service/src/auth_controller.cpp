@@ -1,7 +1,14 @@
 #include "auth_controller.hpp"
 #include <TemplateParser.hpp>
 #include <Utils.hpp>
+#include <JwtVerifier.hpp>
+#include <RevocationList.hpp>
+#include <Coro.hpp>
+#include <ErrorResponses.hpp>
+#include <DbRouter.hpp>
+#include <Uuid.hpp>
 #include <config.hpp>
+#include "refresh_tokens.hpp"
 
 AuthController::AuthController()
 {
@@ -24,225 +31,284 @@ AuthController::AuthController()
     }
 }
 
-void AuthController::createUser(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback)
+namespace
 {
-    Json::Value json = *req->getJsonObject();
+    drogon::Task<> revokeTokens(std::vector<std::pair<std::string, int64_t>> tokens)
+    {
+        auto &revocationList = Utils::RevocationList::instance();
+        for (auto &[tokenId, expiresAt] : tokens)
+        {
+            co_await revocationList.revoke(std::move(tokenId), expiresAt);
+        }
+    }
+
+    drogon::Task<> deleteSession(drogon::orm::DbClientPtr db, std::string userId, std::string sessionId)
+    {
+        co_await db->execSqlCoro("DELETE FROM refresh_tokens WHERE user_id = $1 AND session_id = $2", userId, sessionId);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> AuthController::createUser(drogon::HttpRequestPtr req)
+{
+    const auto json = req->getJsonObject();
+    if (!json)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
+    }
+
     User user;
-    auto error = TemplateParser::parse(json, user);
+    auto error = TemplateParser::parse(*json, user);
     if (error) 
     {
-        Json::Value respJson = error.fullWhat();
-        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(respJson));
-        resp->setStatusCode(drogon::k400BadRequest);
-        callback(std::move(resp));
-        return;
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, error.fullWhat());
     }
 
     if (!Utils::Email::isValidEmail(user.email))
     {
-        auto resp = drogon::HttpResponse::newHttpResponse();
-        resp->setStatusCode(drogon::k400BadRequest);
-        resp->setBody("Not a valid email");
-        callback(std::move(resp));
-        return;
+        co_return Utils::errorResponse(Utils::Error::InvalidEmail);
     }
 
-    auto userId = drogon::utils::getUuid();
-    std::string passwordHash = Utils::Password::hashPassword(user.password);
+    // Time-ordered, so new users are appended to the users primary key
+    auto userId = Utils::Uuid::v7().toString();
+    // argon2 is deliberately slow; keep it off the request event loop
+    std::string passwordHash = co_await Utils::Coro::runOnWorker([&password = user.password] { return Utils::Password::hashPassword(password); });
 
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(callback));
+    try
+    {
+        co_await drogon::app().getDbClient()->execSqlCoro
+        (
+            "INSERT INTO users (id, email, password_hash, role, is_active, created_at, updated_at) " 
+            "VALUES ($1, $2, $3, $4, $5, CURRENT_TIMESTAMP, CURRENT_TIMESTAMP)",
+            userId, user.email, passwordHash, user.role, true
+        );
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
 
-    auto transaction = drogon::app().getDbClient()->newTransaction();
-    transaction->execSqlAsync
-    (
-        "INSERT INTO users (id, email, password_hash, role, is_active, created_at, updated_at) " 
-        "VALUES ($1, $2, $3, $4, $5, CURRENT_TIMESTAMP, CURRENT_TIMESTAMP)",
-        [cb](const drogon::orm::Result& result) 
-        {
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setBody("User registered");
-            resp->setStatusCode(drogon::k201Created);
-            (*cb)(resp);
-        },
-        [cb](const drogon::orm::DrogonDbException& ex) 
-        {
-            spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setBody("Error registering user");
-            resp->setStatusCode(drogon::k500InternalServerError);
-            (*cb)(resp);
-        },
-        userId, user.email, passwordHash, user.role, true
-    );
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setBody("User registered");
+    resp->setStatusCode(drogon::k201Created);
+    co_return resp;
 }
 
-void AuthController::loginUser(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback)
+drogon::Task<drogon::HttpResponsePtr> AuthController::loginUser(drogon::HttpRequestPtr req)
 {
     const auto body = req->getJsonObject();
-    auto email = (*body)["email"].as<std::string>();
-    auto password = (*body)["password"].as<std::string>();
+    if (!body || !(*body)["email"].isString() || !(*body)["password"].isString())
+    {
+        co_return Utils::errorResponse(Utils::Error::MissingCredentials);
+    }
+
+    auto email = (*body)["email"].asString();
+    auto password = (*body)["password"].asString();
 
     if (!Utils::Email::isValidEmail(email))
     {
-        auto resp = drogon::HttpResponse::newHttpResponse();
-        resp->setStatusCode(drogon::k400BadRequest);
-        resp->setBody("Not a valid email");
-        callback(std::move(resp));
-        return;
+        co_return Utils::errorResponse(Utils::Error::InvalidEmail);
     }
 
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr &)>>(std::move(callback));
-    auto transaction = drogon::app().getDbClient()->newTransaction();
+    const auto db = Utils::DbRouter::instance().primary();
 
-    transaction->execSqlAsync
-    (
-        "SELECT id, password_hash FROM users WHERE email = $1",
-        [cb, transaction, password = std::move(password)](const drogon::orm::Result& result)
+    std::string userId;
+    std::string passwordHash;
+    try
+    {
+        static const std::string sql = "SELECT id, password_hash FROM users WHERE email = $1";
+        auto result = co_await Utils::DbRouter::instance().replica()->execSqlCoro(sql, email);
+        // A user who just signed up may not have reached the replica yet
+        if (result.empty())
         {
-            if (result.empty())
-            {
-                auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k404NotFound);
-                resp->setBody("User does not exists");
-                (*cb)(resp);
-                return;
-            }
+            result = co_await db->execSqlCoro(sql, email);
+        }
+        if (result.empty())
+        {
+            co_return Utils::errorResponse(Utils::Error::UserNotFound);
+        }
+        userId = result[0]["id"].as<std::string>();
+        passwordHash = result[0]["password_hash"].as<std::string>();
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
 
-            auto passwordHash = result[0]["password_hash"].as<std::string>();
-            if (!Utils::Password::verifyPassword(passwordHash, password))
-            {
-                auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k401Unauthorized);
-                resp->setBody("Wrong password");
-                (*cb)(resp);
-                return;
-            }
+    const bool passwordMatches = co_await Utils::Coro::runOnWorker([&passwordHash, &password] { return Utils::Password::verifyPassword(passwordHash, password); });
+    if (!passwordMatches)
+    {
+        co_return Utils::errorResponse(Utils::Error::WrongPassword);
+    }
 
-            auto userId = result[0]["id"].as<std::string>();
-
-            auto accessToken = Utils::Jwt::generateJwt(userId, Utils::Jwt::TokenType::ACCESS);
-            auto refreshToken = Utils::Jwt::generateJwt(userId, Utils::Jwt::TokenType::REFRESH, std::chrono::hours{24});
-
-            transaction->execSqlAsync
-            (
-                "INSERT INTO refresh_tokens(user_id, token_hash) "
-                "VALUES($1, $2) ON CONFLICT(user_id) DO UPDATE SET token_hash = EXCLUDED.token_hash;",
-                [](const drogon::orm::Result& result){},
-                [](const drogon::orm::DrogonDbException& ex){},
-                userId,
-                Utils::Password::hashPassword(refreshToken)
-            );
-
-            Json::Value respJson;
-            respJson["accessToken"] = accessToken;
-            respJson["refreshToken"] = accessToken;
-
-            auto resp = drogon::HttpResponse::newHttpJsonResponse(respJson);
-            resp->setStatusCode(drogon::k200OK);
-            (*cb)(resp);
-        },
-        [cb](const drogon::orm::DrogonDbException& ex)
-        {
-            spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setBody("Error registering user");
-            resp->setStatusCode(drogon::k500InternalServerError);
-            (*cb)(resp);
-        },
-        std::move(email)
+    auto sessionId = drogon::utils::getUuid();
+
+    auto accessToken = Utils::Jwt::generateJwt(userId, Utils::Jwt::TokenType::ACCESS, std::chrono::hours{1}, sessionId);
+    auto refreshToken = Utils::Jwt::generateJwt(userId, Utils::Jwt::TokenType::REFRESH, RefreshTokens::lifetime, sessionId);
+
+    static const auto sql = std::format
+    (
+        "INSERT INTO refresh_tokens(user_id, session_id, token_hash, expires_at) "
+        "VALUES($1, $2, $3, CURRENT_TIMESTAMP + INTERVAL '{} hours')",
+        RefreshTokens::lifetime.count()
     );
+
+    try
+    {
+        co_await db->execSqlCoro(sql, userId, sessionId, Utils::Hash::sha256Hex(refreshToken));
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    Json::Value respJson;
+    respJson["accessToken"] = std::move(accessToken);
+    respJson["refreshToken"] = std::move(refreshToken);
+
+    auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(respJson));
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
 }
 
-void AuthController::refreshToken(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback)
+drogon::Task<drogon::HttpResponsePtr> AuthController::refreshToken(drogon::HttpRequestPtr req)
 {
     auto json = req->getJsonObject();
     if (!json || !(*json)["refresh_token"].isString())
     {
-        auto resp = drogon::HttpResponse::newHttpJsonResponse(Json::Value("Missing refresh_token"));
-        resp->setStatusCode(drogon::k400BadRequest);
-        callback(resp);
-        return;
+        co_return Utils::errorResponse(Utils::Error::MissingRefreshToken);
     }
 
     auto refreshToken = (*json)["refresh_token"].asString();
 
-    std::string userId;
+    Utils::Jwt::Claims claims;
     try
     {
-        auto verifiedToken = Utils::Jwt::verifyJwt(refreshToken);
-        if (verifiedToken.type != Utils::Jwt::TokenType::REFRESH)
+        claims = Utils::Jwt::verifyJwt(refreshToken);
+        if (claims.type != Utils::Jwt::TokenType::REFRESH)
         {
-            throw std::runtime_error(std::format("Expected refresh token, got: {}", toString(verifiedToken.type)));
+            throw std::runtime_error(std::format("Expected refresh token, got: {}", toString(claims.type)));
+        }
+        if (claims.sessionId.empty())
+        {
+            throw std::runtime_error("Refresh token has no session");
+        }
+        if (Utils::RevocationList::instance().isRevoked(claims.tokenId))
+        {
+            throw std::runtime_error("Token has been revoked");
         }
-        userId = verifiedToken.decoded.get_payload_claim("sub").as_string();
     }
     catch(const std::exception& e)
     {
-        auto resp = drogon::HttpResponse::newHttpResponse();
-        resp->setStatusCode(drogon::k401Unauthorized);
-        resp->setBody(std::format("Error verifying refresh token: {}", e.what()));
-        callback(resp);
-        return;
+        spdlog::debug("Rejected refresh token: {}", e.what());
+        co_return Utils::errorResponse(Utils::Error::InvalidRefreshToken);
     }
 
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr &)>>(std::move(callback));
-    auto transaction = drogon::app().getDbClient()->newTransaction();
+    auto accessToken = Utils::Jwt::generateJwt(claims.subject, Utils::Jwt::TokenType::ACCESS, std::chrono::hours{1}, claims.sessionId);
+    auto newRefreshToken = Utils::Jwt::generateJwt(claims.subject, Utils::Jwt::TokenType::REFRESH, RefreshTokens::lifetime, claims.sessionId);
 
-    transaction->execSqlAsync
+    // Compare-and-swap: only the holder of the current token of a live session can rotate it
+    static const auto sql = std::format
     (
-        "SELECT token_hash, user_id FROM refresh_tokens WHERE user_id = $1",
-        [cb, transaction, refreshToken = std::move(refreshToken), userId = std::move(userId)]
-        (const drogon::orm::Result& result)
+        "UPDATE refresh_tokens SET token_hash = $4, expires_at = CURRENT_TIMESTAMP + INTERVAL '{} hours' "
+        "WHERE user_id = $1 AND session_id = $2 AND token_hash = $3 AND expires_at > CURRENT_TIMESTAMP",
+        RefreshTokens::lifetime.count()
+    );
+
+    try
+    {
+        const auto result = co_await drogon::app().getDbClient()->execSqlCoro
+        (
+            sql,
+            claims.subject,
+            claims.sessionId,
+            Utils::Hash::sha256Hex(refreshToken),
+            Utils::Hash::sha256Hex(newRefreshToken)
+        );
+        if (result.affectedRows() == 0)
         {
-            if (result.empty())
-            {
-                auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k404NotFound);
-                resp->setBody("Refresh token does not exists");
-                (*cb)(resp);
-                return;
-            }
+            co_return Utils::errorResponse(Utils::Error::RefreshTokenReused);
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    Json::Value respJson;
+    respJson["accessToken"] = std::move(accessToken);
+    respJson["refreshToken"] = std::move(newRefreshToken);
+
+    auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(respJson));
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> AuthController::logoutUser(drogon::HttpRequestPtr req)
+{
+    auto userId = getUserId(req);
+    const auto attributes = req->getAttributes();
 
-            auto tokenHash = result[0]["token_hash"].as<std::string>();
+    std::vector<std::pair<std::string, int64_t>> tokens;
+    tokens.emplace_back(attributes->get<std::string>("tokenId"), attributes->get<int64_t>("tokenExpiresAt"));
 
-            if (!Utils::Password::verifyPassword(tokenHash, refreshToken))
+    const auto json = req->getJsonObject();
+    if (json && (*json)["refresh_token"].isString())
+    {
+        try
+        {
+            auto claims = Utils::Jwt::verifyJwt((*json)["refresh_token"].asString());
+            if (claims.type == Utils::Jwt::TokenType::REFRESH && claims.subject == userId)
             {
-                auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k401Unauthorized);
-                resp->setBody("Error refresh token verification");
-                (*cb)(resp);
-                return;
+                tokens.emplace_back(std::move(claims.tokenId), claims.expiresAt);
             }
-
-            auto accessToken = Utils::Jwt::generateJwt(userId, Utils::Jwt::TokenType::ACCESS);
-            auto refreshToken = Utils::Jwt::generateJwt(userId, Utils::Jwt::TokenType::REFRESH, std::chrono::hours{24});
-
-            transaction->execSqlAsync
-            (
-                "INSERT INTO refresh_tokens(user_id, token_hash) "
-                "VALUES($1, $2) ON CONFLICT(user_id) DO UPDATE SET token_hash = EXCLUDED.token_hash;",
-                [](const drogon::orm::Result& result){},
-                [](const drogon::orm::DrogonDbException& ex){},
-                userId,
-                Utils::Password::hashPassword(refreshToken)
-            );
-
-            Json::Value respJson;
-            respJson["accessToken"] = accessToken;
-            respJson["refreshToken"] = refreshToken;
-
-            auto resp = drogon::HttpResponse::newHttpJsonResponse(respJson);
-            resp->setStatusCode(drogon::k200OK);
-            (*cb)(resp);
-        },
-        [cb](const drogon::orm::DrogonDbException& ex)
+        }
+        catch (const std::exception &e)
         {
-            spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setBody(std::format("Database error: {}", ex.base().what()));
-            resp->setStatusCode(drogon::k500InternalServerError);
-            (*cb)(resp);
-        },
-        std::move(userId)
-    );
+            spdlog::warn("Ignoring invalid refresh token on logout: {}", e.what());
+        }
+    }
+
+    // Revocation in Redis and session removal in the database are independent
+    try
+    {
+        co_await Utils::Coro::whenAll
+        (
+            revokeTokens(std::move(tokens)),
+            deleteSession(drogon::app().getDbClient(), std::move(userId), attributes->get<std::string>("sessionId"))
+        );
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error("Redis error revoking tokens: {}", e.what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    resp->setBody("Logged out");
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> AuthController::jwks(drogon::HttpRequestPtr req)
+{
+    Json::Value json;
+    json["keys"] = Json::arrayValue;
+
+    if (const auto keys = Utils::Jwt::KeyStore::instance().snapshot())
+    {
+        json = keys->publicJwks();
+    }
+
+    auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
 }
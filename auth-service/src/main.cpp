@@ -1,16 +1,49 @@
 #include <config.hpp>
 #include <drogon/drogon.h>
 #include <JwtAuthFilter.hpp>
+#include <RevocationList.hpp>
+#include <Scheduler.hpp>
+#include "refresh_tokens.hpp"
 
 int main()
 {
     spdlog::set_level(spdlog::level::info);
 
+    if (!Config::authServiceJwtKeysFile.empty())
+    {
+        Utils::Jwt::KeyStore::instance().watchFile(std::string(Config::authServiceJwtKeysFile),
+                                                   std::chrono::seconds{Config::jwtKeysReloadSeconds});
+    }
+
+    // Without a signing key every token would fall back to the shared secret
+    const auto keys = Utils::Jwt::KeyStore::instance().snapshot();
+    if (!Config::jwtAllowHs256 && (!keys || !keys->signingKey()))
+    {
+        spdlog::critical("No JWT signing key: AUTH_SERVICE_JWT_KEYS_FILE must name a JWKS with a private key");
+        return 1;
+    }
+
+    Utils::Scheduler scheduler{"auth-service"};
+    scheduler.addJob
+    ({
+        .name = "purge-refresh-tokens",
+        .interval = std::chrono::minutes{10},
+        .task = [](Utils::Scheduler::Done done)
+        {
+            RefreshTokens::purgeExpired(drogon::app().getDbClient(), 1000, std::move(done));
+        }
+    });
+
     drogon::app()
         .addListener(Config::authServiceHost.data(), Config::authServicePort)
         .setThreadNum(std::thread::hardware_concurrency() - 1)
         .loadConfigFile("./auth-service-drogon-db-config.json")
         .registerFilter<JwtAuthFilter>(std::make_shared<JwtAuthFilter>())
+        .registerBeginningAdvice([&scheduler]
+        {
+            Utils::RevocationList::instance().start();
+            scheduler.start();
+        })
         .run();
 
     return 0;
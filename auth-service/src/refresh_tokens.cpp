@@ -0,0 +1,31 @@
+#include "refresh_tokens.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace RefreshTokens
+{
+    drogon::AsyncTask purgeExpired(drogon::orm::DbClientPtr db, size_t batchSize, std::function<void()> done)
+    {
+        try
+        {
+            size_t purged = 0;
+            do
+            {
+                const auto result = co_await db->execSqlCoro
+                (
+                    "DELETE FROM refresh_tokens WHERE ctid = ANY(ARRAY("
+                    "SELECT ctid FROM refresh_tokens WHERE expires_at < CURRENT_TIMESTAMP LIMIT $1))",
+                    static_cast<int64_t>(batchSize)
+                );
+                purged = result.affectedRows();
+                spdlog::debug("Purged {} expired refresh tokens", purged);
+            }
+            while (purged == batchSize);
+        }
+        catch (const drogon::orm::DrogonDbException& ex)
+        {
+            spdlog::error("Error purging refresh tokens: {}", ex.base().what());
+        }
+        done();
+    }
+}
@@ -4,6 +4,7 @@
 #include <boost/mp11.hpp>
 #include <boost/describe.hpp>
 #include <format>
+#include <utility>
 
 #include "ParserType.hpp"
 #include "ParseError.hpp"
@@ -164,14 +165,21 @@ namespace TemplateParser
         }
     };
 
-    template<typename T> requires Concepts::isJsonValue<T>
-    struct ParseImpl<T, std::string>
+    /**
+     * @brief Парсит Json::Value в строку с любым аллокатором (в т.ч. std::pmr::string).
+     * Строка копируется напрямую из буфера Json::Value, без временного std::string.
+     */
+    template<typename T, typename Alloc> requires Concepts::isJsonValue<T>
+    struct ParseImpl<T, std::basic_string<char, std::char_traits<char>, Alloc>>
     {
-        static ParseError doParse(const T &src, std::string &dst)
+        static ParseError doParse(const T &src, std::basic_string<char, std::char_traits<char>, Alloc> &dst)
         {
             if (src.type() == Json::ValueType::stringValue)
             {
-                dst = src.asString();
+                const char *begin = nullptr;
+                const char *end = nullptr;
+                src.getString(&begin, &end);
+                dst.assign(begin, end);
             }
             else if (src.isNumeric())
             {
@@ -476,7 +484,6 @@ namespace TemplateParser
 
         //Генерация описания членов структуры dst(Можно получить имя и ссылку, а по ссылке тип)
         using D1 = describe_members<T, mod_public | mod_protected | mod_inherited>;
-        const auto srcKeys = src.getMemberNames();
 
         std::array<ParseError, mp_size<D1>::value> errors;
         auto it = std::begin(errors);
@@ -487,7 +494,7 @@ namespace TemplateParser
             ParseError &currentError = *it;
             auto &valueIntoStruct = dst.*D.pointer;
             using TrueType = std::remove_reference_t<decltype(valueIntoStruct)>;
-            if (std::find(srcKeys.begin(), srcKeys.end(), D.name) == srcKeys.end())
+            if (!src.isMember(D.name))
             {
                 //Отсутствие не опциональных членов не допустимо
                 if (!(Concepts::isOptional<TrueType>::value || TemplateParser::ParserType::isGetFromParsing<TrueType>))
@@ -536,8 +543,6 @@ namespace TemplateParser
                 return ParseError("error validate: ").addSubError(std::move(errorValidate));
             }
 
-            const auto srcKeys = src.getMemberNames();
-
             std::array<ParseError, mp_size<D1>::value> errors;
             auto it = std::begin(errors);
             mp_for_each<D1>([&](auto D)
@@ -545,14 +550,15 @@ namespace TemplateParser
                 ParseError &currentError = *it;
                 auto &valueIntoStruct = dst.*D.pointer;
 
-                if (std::find(srcKeys.begin(), srcKeys.end(), D.name) == srcKeys.end())
+                // isMember/const operator[] ищут ключ без копирования списка ключей и значения
+                if (!src.isMember(D.name))
                 {
                     ++it;
                     return;
                 }
 
-                auto value = src[D.name];
-                if (auto error = parse(std::move(value), valueIntoStruct);
+                const auto &value = std::as_const(src)[D.name];
+                if (auto error = parse(value, valueIntoStruct);
                     error)
                 {
                     currentError = std::format("parameter {}: error parsing", D.name);
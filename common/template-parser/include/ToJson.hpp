@@ -52,6 +52,20 @@ namespace TemplateParser
         }
     };
 
+    /**
+     * @brief Строки с нестандартным аллокатором (например std::pmr::string), из которых
+     * Json::Value напрямую не конструируется
+     */
+    template<typename Alloc> requires (!std::is_same_v<Alloc, std::allocator<char>>)
+    struct ToJsonImpl<std::basic_string<char, std::char_traits<char>, Alloc>>
+    {
+        template<typename U>
+        static Json::Value doToJson(U &&src)
+        {
+            return Json::Value{src.data(), src.data() + src.size()};
+        }
+    };
+
     template<typename T> requires Concepts::isContainer<T> && (!Concepts::isString<T>)
     struct ToJsonImpl<T>
     {
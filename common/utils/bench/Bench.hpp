@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal timing harness shared by the bench targets. `run` calls a body in a
+ * tight loop on one or more threads for a fixed time and counts the calls;
+ * every thread builds its own body, so per-thread state (thread-local
+ * verifiers, arenas) is set up outside the timed loop.
+ */
+namespace Bench
+{
+    struct Result
+    {
+        uint64_t ops = 0;
+        double seconds = 0;
+        unsigned threads = 1;
+
+        double perSecond() const { return static_cast<double>(ops) / seconds; }
+        double perSecondPerThread() const { return perSecond() / threads; }
+    };
+
+    // Seconds each case runs for: the first argument of the bench, 2 by default.
+    inline std::chrono::milliseconds duration(int argc, char **argv)
+    {
+        const auto seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+        return std::chrono::milliseconds{static_cast<int64_t>((seconds > 0 ? seconds : 2.0) * 1000)};
+    }
+
+    // `makeBody()` is called once on every thread; the callable it returns is timed.
+    template<typename MakeBody>
+    Result run(MakeBody makeBody, std::chrono::milliseconds duration, unsigned threads = 1)
+    {
+        constexpr uint64_t stride = 64;
+
+        std::atomic<unsigned> ready{0};
+        std::atomic<bool> go{false};
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> total{0};
+
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([&]
+            {
+                auto body = makeBody();
+                body();
+                ready.fetch_add(1);
+                while (!go.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                uint64_t ops = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    for (uint64_t k = 0; k < stride; ++k)
+                    {
+                        body();
+                    }
+                    ops += stride;
+                }
+                total.fetch_add(ops);
+            });
+        }
+
+        while (ready.load() < threads)
+        {
+            std::this_thread::yield();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(duration);
+        stop.store(true);
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return {total.load(), elapsed.count(), threads};
+    }
+
+    inline void print(std::string_view name, const Result &result)
+    {
+        std::cout << std::format("{:<44} {:>2} thread(s) {:>14.0f} ops/s {:>12.0f} ops/s/thread\n",
+                                 name, result.threads, result.perSecond(), result.perSecondPerThread());
+    }
+}//namespace Bench
@@ -0,0 +1,145 @@
+// arena-alloc-bench: heap allocations and throughput of parsing a createNote
+// body, with the fields in heap strings as before and in pmr strings backed by
+// a RequestArena as now. Both include the JSON DOM drogon builds first, which
+// stays on the heap either way.
+//
+// Usage: arena-alloc-bench [seconds per case]
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <thread>
+#include <json/json.h>
+#include <boost/describe.hpp>
+#include <TemplateParser.hpp>
+#include <RequestArena.hpp>
+#include "Bench.hpp"
+
+namespace
+{
+    // Per thread, so counting adds no contention to the multi-threaded runs
+    thread_local uint64_t allocations = 0;
+}
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    // Same fields as NoteController::PostBody, before and after the arena
+    struct HeapBody
+    {
+        std::string title;
+        std::string content;
+
+        BOOST_DESCRIBE_CLASS(HeapBody, (), (title, content), (), ());
+    };
+
+    struct ArenaBody
+    {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        ArenaBody() = default;
+        explicit ArenaBody(allocator_type allocator) : title(allocator), content(allocator) {}
+
+        std::pmr::string title;
+        std::pmr::string content;
+
+        BOOST_DESCRIBE_CLASS(ArenaBody, (), (title, content), (), ());
+    };
+
+    const std::string requestBody = []
+    {
+        Json::Value body;
+        body["title"] = "Groceries and errands for the weekend";
+        body["content"] = std::string(600, 'x');
+        return Json::writeString(Json::StreamWriterBuilder{}, body);
+    }();
+
+    class Request
+    {
+    public:
+        Request() : m_reader(Json::CharReaderBuilder{}.newCharReader()) {}
+
+        Json::Value json()
+        {
+            Json::Value json;
+            m_reader->parse(requestBody.data(), requestBody.data() + requestBody.size(), &json, nullptr);
+            return json;
+        }
+
+    private:
+        std::unique_ptr<Json::CharReader> m_reader;
+    };
+
+    void parseHeap(Request &request)
+    {
+        const auto json = request.json();
+        HeapBody body;
+        if (TemplateParser::parse(json, body))
+        {
+            std::abort();
+        }
+    }
+
+    void parseArena(Request &request)
+    {
+        const auto json = request.json();
+        // Held by the request attributes in the service, so it is one allocation there too
+        const auto arena = std::make_shared<Utils::RequestArena>();
+        ArenaBody body{arena->allocator<char>()};
+        if (TemplateParser::parse(json, body))
+        {
+            std::abort();
+        }
+    }
+
+    template<typename Parse>
+    void runCase(const char *name, Parse parse, std::chrono::milliseconds duration)
+    {
+        constexpr uint64_t samples = 10'000;
+        Request request;
+        parse(request);
+        const auto before = allocations;
+        for (uint64_t i = 0; i < samples; ++i)
+        {
+            parse(request);
+        }
+        std::cout << std::format("{:<44} {:>8.1f} allocations/request\n", name, static_cast<double>(allocations - before) / samples);
+
+        const auto makeBody = [parse]
+        {
+            return [parse, request = std::make_shared<Request>()] { parse(*request); };
+        };
+        Bench::print(name, Bench::run(makeBody, duration, 1));
+        Bench::print(name, Bench::run(makeBody, duration, std::thread::hardware_concurrency()));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const auto duration = Bench::duration(argc, argv);
+
+    runCase("createNote body, heap strings", parseHeap, duration);
+    runCase("createNote body, RequestArena", parseArena, duration);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+// jwt-verify-bench: access token verifications per second, per thread and on
+// all cores, through the thread-local Verifier JwtAuthFilter uses. The HS256
+// case also runs the per-call jwt-cpp verifier it replaced, for comparison.
+//
+// Usage: jwt-verify-bench [seconds per case]
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <json/json.h>
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <jwt-cpp/jwt.h>
+#include <jwt-cpp/traits/kazuho-picojson/traits.h>
+#include <config.hpp>
+#include <JwtVerifier.hpp>
+#include "Bench.hpp"
+
+namespace
+{
+    using Picojson = jwt::traits::kazuho_picojson;
+
+    Utils::Jwt::Detail::PkeyPtr generateKey(const char *type, const char *curve = nullptr)
+    {
+        EVP_PKEY *key = curve ? EVP_PKEY_Q_keygen(nullptr, nullptr, type, curve) : EVP_PKEY_Q_keygen(nullptr, nullptr, type);
+        if (!key)
+        {
+            throw std::runtime_error(std::string("Error generating ") + type + " key");
+        }
+        return Utils::Jwt::Detail::PkeyPtr{key};
+    }
+
+    std::string rawKey(EVP_PKEY *key, bool isPrivate)
+    {
+        std::string raw(32, '\0');
+        size_t length = raw.size();
+        const auto ok = isPrivate
+            ? EVP_PKEY_get_raw_private_key(key, reinterpret_cast<unsigned char *>(raw.data()), &length)
+            : EVP_PKEY_get_raw_public_key(key, reinterpret_cast<unsigned char *>(raw.data()), &length);
+        if (ok != 1)
+        {
+            throw std::runtime_error("Error exporting Ed25519 key");
+        }
+        return Utils::Jwt::Detail::encodeBase64Url(raw);
+    }
+
+    std::string bigNumber(EVP_PKEY *key, const char *name)
+    {
+        BIGNUM *number = nullptr;
+        std::string raw(32, '\0');
+        if (EVP_PKEY_get_bn_param(key, name, &number) != 1 ||
+            BN_bn2binpad(number, reinterpret_cast<unsigned char *>(raw.data()), static_cast<int>(raw.size())) != 32)
+        {
+            BN_clear_free(number);
+            throw std::runtime_error("Error exporting P-256 key");
+        }
+        BN_clear_free(number);
+        return Utils::Jwt::Detail::encodeBase64Url(raw);
+    }
+
+    // Private JWKS with one fresh Ed25519 and one fresh P-256 key
+    std::string makeJwks()
+    {
+        const auto ed25519 = generateKey("ED25519");
+        const auto p256 = generateKey("EC", "P-256");
+
+        Json::Value edJwk;
+        edJwk["kid"] = "bench-ed25519";
+        edJwk["kty"] = "OKP";
+        edJwk["crv"] = "Ed25519";
+        edJwk["x"] = rawKey(ed25519.get(), false);
+        edJwk["d"] = rawKey(ed25519.get(), true);
+
+        Json::Value ecJwk;
+        ecJwk["kid"] = "bench-p256";
+        ecJwk["kty"] = "EC";
+        ecJwk["crv"] = "P-256";
+        ecJwk["x"] = bigNumber(p256.get(), OSSL_PKEY_PARAM_EC_PUB_X);
+        ecJwk["y"] = bigNumber(p256.get(), OSSL_PKEY_PARAM_EC_PUB_Y);
+        ecJwk["d"] = bigNumber(p256.get(), OSSL_PKEY_PARAM_PRIV_KEY);
+
+        Json::Value jwks;
+        jwks["keys"].append(edJwk);
+        jwks["keys"].append(ecJwk);
+        return Json::writeString(Json::StreamWriterBuilder{}, jwks);
+    }
+
+    // Same claims generateJwt puts into an access token
+    auto accessToken()
+    {
+        return jwt::create<Picojson>()
+            .set_type("JWT")
+            .set_issuer("auth-service")
+            .set_payload_claim("type", Picojson::value_type{std::string("access")})
+            .set_subject("0190d7a4-5c1e-7b3a-8f2d-6e4c9a1b2c3d")
+            .set_id("0190d7a4-5c1e-7b3a-8f2d-6e4c9a1b2c3e")
+            .set_issued_at(std::chrono::system_clock::now())
+            .set_expires_at(std::chrono::system_clock::now() + std::chrono::hours{1});
+    }
+
+    std::string signWith(const char *kid)
+    {
+        const auto keys = Utils::Jwt::KeyStore::instance().snapshot();
+        return accessToken().set_key_id(kid).sign(Utils::Jwt::KeySigner{*keys->find(kid)});
+    }
+
+    void runCase(const char *name, const std::string &token, std::chrono::milliseconds duration)
+    {
+        const auto makeBody = [&token]
+        {
+            return [&token] { Utils::Jwt::verifyJwt(token); };
+        };
+        Bench::print(name, Bench::run(makeBody, duration, 1));
+        Bench::print(name, Bench::run(makeBody, duration, std::thread::hardware_concurrency()));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const auto duration = Bench::duration(argc, argv);
+
+    Utils::Jwt::KeyStore::instance().load(makeJwks());
+    runCase("EdDSA (Verifier)", signWith("bench-ed25519"), duration);
+    runCase("ES256 (Verifier)", signWith("bench-p256"), duration);
+
+    if (!Config::jwtAllowHs256)
+    {
+        std::cout << "HS256 skipped: JWT_ALLOW_HS256 is off\n";
+        return 0;
+    }
+
+    const std::string secret(Config::jwtSecretKey);
+    const auto hs256 = accessToken().sign(jwt::algorithm::hs256{secret});
+    runCase("HS256 (Verifier)", hs256, duration);
+
+    // What every request did before: decode, then build the algorithm and verifier
+    const auto makeLegacy = [&]
+    {
+        return [&]
+        {
+            const auto decoded = jwt::decode<Picojson>(hs256);
+            jwt::verify<Picojson>()
+                .allow_algorithm(jwt::algorithm::hs256{secret})
+                .with_issuer("auth-service")
+                .verify(decoded);
+        };
+    };
+    Bench::print("HS256 (jwt-cpp, per call)", Bench::run(makeLegacy, duration, 1));
+    Bench::print("HS256 (jwt-cpp, per call)", Bench::run(makeLegacy, duration, std::thread::hardware_concurrency()));
+
+    return 0;
+}
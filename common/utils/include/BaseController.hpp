@@ -1,6 +1,7 @@
 #pragma once
 
 #include <drogon/HttpController.h>
+#include <drogon/utils/coroutine.h>
 #include <string>
 
 template<typename T>
@@ -9,6 +10,6 @@ class BaseController : public drogon::HttpController<T>
 protected:
     std::string getUserId(const drogon::HttpRequestPtr &req)
     {
-        return req->getAttributes()->get<std::string>("userId"); 
+        return req->getAttributes()->get<std::string>("userId");
     }
-};
\ No newline at end of file
+};
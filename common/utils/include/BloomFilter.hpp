@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace Utils
+{
+    /**
+     * Fixed-size bloom filter over strings. Bits are stored in atomic words, so
+     * `mayContain` may run concurrently with `add` without locks; `clear` must not
+     * race with readers that still rely on the result.
+     */
+    class BloomFilter
+    {
+    public:
+        // `bitCount` is rounded up to a power of two.
+        BloomFilter(size_t bitCount, uint32_t hashCount)
+            : m_mask(std::bit_ceil(bitCount < 64 ? size_t{64} : bitCount) - 1)
+            , m_hashCount(hashCount)
+            , m_words(std::make_unique<std::atomic<uint64_t>[]>((m_mask + 1) / 64))
+        {
+        }
+
+        void add(std::string_view key)
+        {
+            forEachBit(key, [this](size_t bit)
+            {
+                m_words[bit / 64].fetch_or(uint64_t{1} << (bit % 64), std::memory_order_relaxed);
+                return true;
+            });
+        }
+
+        bool mayContain(std::string_view key) const
+        {
+            return forEachBit(key, [this](size_t bit)
+            {
+                return (m_words[bit / 64].load(std::memory_order_relaxed) & (uint64_t{1} << (bit % 64))) != 0;
+            });
+        }
+
+        void clear()
+        {
+            for (size_t i = 0; i < (m_mask + 1) / 64; ++i)
+            {
+                m_words[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static uint64_t mix(uint64_t x)
+        {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            return x;
+        }
+
+        // Double hashing (Kirsch-Mitzenmacher): probe i is h1 + i * h2.
+        template<typename F>
+        bool forEachBit(std::string_view key, F &&f) const
+        {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            for (unsigned char c : key)
+            {
+                hash = (hash ^ c) * 0x100000001b3ULL;
+            }
+
+            const uint64_t h1 = mix(hash);
+            const uint64_t h2 = mix(h1) | 1;
+            for (uint32_t i = 0; i < m_hashCount; ++i)
+            {
+                if (!f(static_cast<size_t>((h1 + i * h2) & m_mask)))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        size_t m_mask;
+        uint32_t m_hashCount;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+    };
+}//namespace Utils
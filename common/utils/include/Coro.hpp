@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <drogon/utils/coroutine.h>
+#include <trantor/net/EventLoop.h>
+#include <trantor/net/EventLoopThreadPool.h>
+
+namespace Utils::Coro
+{
+    /**
+     * Resumes the awaiting coroutine on `loop`. A no-op when already running there
+     * or when `loop` is null.
+     */
+    struct ResumeOn
+    {
+        trantor::EventLoop *loop;
+
+        bool await_ready() const noexcept { return loop == nullptr || loop->isInLoopThread(); }
+        void await_suspend(std::coroutine_handle<> handle) const { loop->queueInLoop([handle] { handle.resume(); }); }
+        void await_resume() const noexcept {}
+    };
+
+    // Threads for CPU-bound work (password hashing, signing) that must not block
+    // the request event loops.
+    inline trantor::EventLoopThreadPool &workerPool()
+    {
+        static auto *pool = []
+        {
+            auto *pool = new trantor::EventLoopThreadPool(std::max(1u, std::thread::hardware_concurrency()), "worker");
+            pool->start();
+            return pool;
+        }();
+        return *pool;
+    }
+
+    /**
+     * Runs `fn` on the worker pool and resumes the caller on the event loop it was
+     * awaited from. Exceptions thrown by `fn` are rethrown to the caller.
+     */
+    template<typename F>
+    drogon::Task<std::invoke_result_t<F>> runOnWorker(F fn)
+    {
+        using Result = std::invoke_result_t<F>;
+        auto *origin = trantor::EventLoop::getEventLoopOfCurrentThread();
+
+        co_await ResumeOn{workerPool().getNextLoop()};
+
+        std::exception_ptr error;
+        std::optional<std::conditional_t<std::is_void_v<Result>, std::monostate, Result>> result;
+        try
+        {
+            if constexpr (std::is_void_v<Result>)
+            {
+                fn();
+                result.emplace();
+            }
+            else
+            {
+                result.emplace(fn());
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        co_await ResumeOn{origin};
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        if constexpr (!std::is_void_v<Result>)
+        {
+            co_return std::move(*result);
+        }
+    }
+
+    namespace Detail
+    {
+        template<typename A>
+        decltype(auto) awaiterOf(A &&awaitable)
+        {
+            if constexpr (requires { std::forward<A>(awaitable).operator co_await(); })
+            {
+                return std::forward<A>(awaitable).operator co_await();
+            }
+            else
+            {
+                return std::forward<A>(awaitable);
+            }
+        }
+
+        template<typename A>
+        using RawResult = decltype(awaiterOf(std::declval<A>()).await_resume());
+
+        // void results are reported as std::monostate so they fit in a tuple
+        template<typename A>
+        using Result = std::conditional_t<std::is_void_v<RawResult<A>>, std::monostate, std::decay_t<RawResult<A>>>;
+
+        template<typename... A>
+        struct WhenAllState
+        {
+            std::tuple<std::optional<Result<A>>...> results;
+            std::atomic<size_t> remaining{sizeof...(A) + 1};
+            std::coroutine_handle<> waiter;
+
+            std::mutex errorMutex;
+            std::exception_ptr error;
+
+            void complete()
+            {
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    waiter.resume();
+                }
+            }
+        };
+
+        template<size_t I, typename State, typename A>
+        drogon::AsyncTask runOne(std::shared_ptr<State> state, A awaitable)
+        {
+            try
+            {
+                if constexpr (std::is_void_v<RawResult<A>>)
+                {
+                    co_await std::move(awaitable);
+                    std::get<I>(state->results).emplace();
+                }
+                else
+                {
+                    std::get<I>(state->results).emplace(co_await std::move(awaitable));
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard lock(state->errorMutex);
+                if (!state->error)
+                {
+                    state->error = std::current_exception();
+                }
+            }
+            state->complete();
+        }
+    }//namespace Detail
+
+    /**
+     * Starts all awaitables at once and resumes when every one of them has
+     * finished, returning their results in order (std::monostate for void).
+     * If any of them throws, the first exception is rethrown after all complete.
+     */
+    template<typename... A>
+    drogon::Task<std::tuple<Detail::Result<A>...>> whenAll(A... awaitables)
+    {
+        using State = Detail::WhenAllState<A...>;
+
+        struct Awaiter
+        {
+            std::shared_ptr<State> state;
+            std::tuple<A...> awaitables;
+
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                state->waiter = handle;
+                [this]<size_t... I>(std::index_sequence<I...>)
+                {
+                    (Detail::runOne<I>(state, std::move(std::get<I>(awaitables))), ...);
+                }(std::index_sequence_for<A...>{});
+
+                // The extra count held while launching keeps a fast completion from
+                // resuming the waiter before it is suspended
+                return state->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        auto state = std::make_shared<State>();
+        Awaiter awaiter{state, std::tuple<A...>(std::move(awaitables)...)};
+        co_await awaiter;
+
+        if (state->error)
+        {
+            std::rethrow_exception(state->error);
+        }
+        co_return std::apply([](auto &...results) { return std::tuple<Detail::Result<A>...>(std::move(*results)...); }, state->results);
+    }
+}//namespace Utils::Coro
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <drogon/orm/DbClient.h>
+#include <spdlog/spdlog.h>
+#include "ExpiringCache.hpp"
+
+namespace Utils
+{
+    /**
+     * Picks the database client for a query. Writes, and reads that must see
+     * them, use a shard's primary (`default` for unsharded data); other reads use
+     * its replica, the client named `<shard>-replica`. The config must define a
+     * replica for every shard, pointing it at the primary where there is none.
+     *
+     * A user who wrote within `readYourWritesWindow` reads from the primary, so
+     * replication lag never hides their own changes. Writes are announced on the
+     * Redis channel `recent-writes`, so the marker holds on every node.
+     */
+    class DbRouter
+    {
+    public:
+        static constexpr std::string_view channel = "recent-writes";
+        static constexpr std::string_view defaultShard = "default";
+        static constexpr std::chrono::seconds readYourWritesWindow{5};
+
+        static DbRouter &instance()
+        {
+            static DbRouter router;
+            return router;
+        }
+
+        drogon::orm::DbClientPtr primary(std::string_view shard = defaultShard) const
+        {
+            return drogon::app().getDbClient(std::string(shard));
+        }
+
+        drogon::orm::DbClientPtr replica(std::string_view shard = defaultShard) const
+        {
+            return drogon::app().getDbClient(std::string(shard).append("-replica"));
+        }
+
+        drogon::orm::DbClientPtr forRead(const std::string &userId, std::string_view shard = defaultShard) const
+        {
+            return m_recentWrites.get(userId) ? primary(shard) : replica(shard);
+        }
+
+        void markWrittenLocally(const std::string &userId)
+        {
+            m_recentWrites.put(userId, true, readYourWritesWindow);
+        }
+
+        void markWritten(const std::string &userId)
+        {
+            markWrittenLocally(userId);
+
+            drogon::app().getRedisClient()->execCommandAsync
+            (
+                [](const drogon::nosql::RedisResult &) {},
+                [](const std::exception &e) { spdlog::error("Redis error publishing write marker: {}", e.what()); },
+                "PUBLISH %s %s", channel.data(), userId.c_str()
+            );
+        }
+
+        // Subscribes to write markers from other nodes. Call once the Redis client exists.
+        void start()
+        {
+            m_subscriber = drogon::app().getRedisClient()->newSubscriber();
+            m_subscriber->subscribe(std::string(channel), [this](const std::string &, const std::string &userId)
+            {
+                markWrittenLocally(userId);
+            });
+        }
+
+    private:
+        DbRouter()
+            : m_recentWrites(100'000)
+        {
+        }
+
+    private:
+        ExpiringCache<std::string, bool> m_recentWrites;
+        drogon::nosql::RedisSubscriberPtr m_subscriber;
+    };
+}//namespace Utils
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Utils::Delta
+{
+    namespace Detail
+    {
+        inline void writeVarint(std::vector<char> &out, uint64_t value)
+        {
+            do
+            {
+                auto byte = static_cast<uint8_t>(value & 0x7f);
+                value >>= 7;
+                if (value != 0)
+                {
+                    byte |= 0x80;
+                }
+                out.push_back(static_cast<char>(byte));
+            } while (value != 0);
+        }
+
+        inline uint64_t readVarint(std::span<const char> &in)
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (in.empty())
+                {
+                    break;
+                }
+                const auto byte = static_cast<uint8_t>(in.front());
+                in = in.subspan(1);
+                value |= uint64_t{byte & 0x7fu} << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+            throw std::invalid_argument("Malformed delta");
+        }
+    }//namespace Detail
+
+    /**
+     * Encodes `to` as an edit of `from`: the length of the common prefix and of
+     * the common suffix (LEB128 varints), then the bytes that replace everything
+     * between them. A save usually touches one region of a text, so the delta is
+     * about the size of the edit; scattered edits degrade towards a full copy.
+     */
+    inline std::vector<char> encode(std::string_view from, std::string_view to)
+    {
+        const auto shorter = std::min(from.size(), to.size());
+
+        size_t prefix = 0;
+        while (prefix < shorter && from[prefix] == to[prefix])
+        {
+            ++prefix;
+        }
+        size_t suffix = 0;
+        while (suffix < shorter - prefix && from[from.size() - 1 - suffix] == to[to.size() - 1 - suffix])
+        {
+            ++suffix;
+        }
+
+        std::vector<char> delta;
+        delta.reserve(to.size() - prefix - suffix + 2 * sizeof(uint64_t));
+        Detail::writeVarint(delta, prefix);
+        Detail::writeVarint(delta, suffix);
+        delta.insert(delta.end(), to.begin() + prefix, to.end() - suffix);
+        return delta;
+    }
+
+    // Rebuilds the text `delta` was encoded against `base` from. Throws
+    // std::invalid_argument when the delta does not fit `base`.
+    inline std::string apply(std::string_view base, std::span<const char> delta)
+    {
+        const auto prefix = Detail::readVarint(delta);
+        const auto suffix = Detail::readVarint(delta);
+        if (prefix > base.size() || suffix > base.size() - prefix)
+        {
+            throw std::invalid_argument("Delta does not match its base");
+        }
+
+        std::string result;
+        result.reserve(prefix + delta.size() + suffix);
+        result.append(base.substr(0, prefix));
+        result.append(delta.data(), delta.size());
+        result.append(base.substr(base.size() - suffix));
+        return result;
+    }
+}//namespace Utils::Delta
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <drogon/HttpResponse.h>
+#include <json/json.h>
+
+namespace Utils
+{
+    enum class Error
+    {
+        InvalidJson,
+        InvalidBody,
+        InvalidEmail,
+        MissingCredentials,
+        UserNotFound,
+        WrongPassword,
+        MissingRefreshToken,
+        InvalidRefreshToken,
+        RefreshTokenReused,
+        MissingAuthorization,
+        InvalidToken,
+        TokenRevoked,
+        NoteNotFound,
+        FolderNotFound,
+        RevisionNotFound,
+        RevisionConflict,
+        AttachmentNotFound,
+        AttachmentTooLarge,
+        BodyTooLarge,
+        TooManyFields,
+        Forbidden,
+        UserMoving,
+        NotReady,
+        ImportBusy,
+        ResyncRequired,
+        Internal,
+    };
+
+    struct ErrorInfo
+    {
+        drogon::HttpStatusCode status;
+        std::string_view code;
+        std::string_view message;
+    };
+
+    // Indexed by Error; `code` is the stable machine-readable value clients match on
+    inline constexpr std::array<ErrorInfo, 26> errorInfos
+    {{
+        {drogon::k400BadRequest, "invalid_json", "Invalid JSON"},
+        {drogon::k400BadRequest, "invalid_body", "Request body does not match the expected schema"},
+        {drogon::k400BadRequest, "invalid_email", "Not a valid email"},
+        {drogon::k400BadRequest, "missing_credentials", "Missing email or password"},
+        {drogon::k404NotFound, "user_not_found", "User does not exist"},
+        {drogon::k401Unauthorized, "wrong_password", "Wrong password"},
+        {drogon::k400BadRequest, "missing_refresh_token", "Missing refresh_token"},
+        {drogon::k401Unauthorized, "invalid_refresh_token", "Invalid refresh token"},
+        {drogon::k401Unauthorized, "refresh_token_reused", "Refresh token is expired or already used"},
+        {drogon::k401Unauthorized, "missing_authorization", "Missing or invalid Authorization header"},
+        {drogon::k401Unauthorized, "invalid_token", "Invalid token"},
+        {drogon::k401Unauthorized, "token_revoked", "Token has been revoked"},
+        {drogon::k404NotFound, "note_not_found", "Note not found"},
+        {drogon::k404NotFound, "folder_not_found", "Folder not found"},
+        {drogon::k404NotFound, "revision_not_found", "Revision not found"},
+        {drogon::k409Conflict, "revision_conflict", "Note has changed since baseRevision"},
+        {drogon::k404NotFound, "attachment_not_found", "Attachment not found"},
+        {drogon::k413RequestEntityTooLarge, "attachment_too_large", "Attachment is too large"},
+        {drogon::k413RequestEntityTooLarge, "body_too_large", "Request body is too large"},
+        {drogon::k400BadRequest, "too_many_fields", "Can not update more than one parameter at a time"},
+        {drogon::k403Forbidden, "forbidden", "Not allowed to perform this action"},
+        {drogon::k503ServiceUnavailable, "user_moving", "Your data is being moved, retry shortly"},
+        {drogon::k503ServiceUnavailable, "not_ready", "Service is starting, retry shortly"},
+        {drogon::k429TooManyRequests, "import_busy", "Too many imports are running, retry later"},
+        {drogon::k410Gone, "resync_required", "Changes since this point are no longer available, sync from 0"},
+        {drogon::k500InternalServerError, "internal_error", "Internal server error"},
+    }};
+
+    constexpr const ErrorInfo &describe(Error error) { return errorInfos[static_cast<size_t>(error)]; }
+
+    namespace Detail
+    {
+        inline Json::Value errorJson(Error error)
+        {
+            const auto &info = describe(error);
+
+            Json::Value json;
+            json["error"] = Json::Value(info.code.data(), info.code.data() + info.code.size());
+            json["message"] = Json::Value(info.message.data(), info.message.data() + info.message.size());
+            return json;
+        }
+
+        inline drogon::HttpResponsePtr buildErrorResponse(Error error, std::string_view details)
+        {
+            auto json = errorJson(error);
+            if (!details.empty())
+            {
+                json["details"] = Json::Value(details.data(), details.data() + details.size());
+            }
+
+            auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+            resp->setStatusCode(describe(error).status);
+            return resp;
+        }
+    }//namespace Detail
+
+    /**
+     * Response for `error`. The JSON body of every error is serialized once per
+     * process; each call builds a new response around a copy of it, so callers
+     * may add headers. Responses are never shared: drogon caches a handler's
+     * response per route when its expiry is set, which would replay one error
+     * to every later request.
+     */
+    inline drogon::HttpResponsePtr errorResponse(Error error)
+    {
+        static const auto bodies = []
+        {
+            Json::StreamWriterBuilder writer;
+            writer["indentation"] = "";
+
+            std::array<std::string, errorInfos.size()> bodies;
+            for (size_t i = 0; i < bodies.size(); ++i)
+            {
+                bodies[i] = Json::writeString(writer, Detail::errorJson(static_cast<Error>(i)));
+            }
+            return bodies;
+        }();
+
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(describe(error).status);
+        resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+        resp->setBody(bodies[static_cast<size_t>(error)]);
+        return resp;
+    }
+
+    // Fresh response for errors that carry request-specific details, e.g. parse errors.
+    inline drogon::HttpResponsePtr errorResponse(Error error, std::string_view details)
+    {
+        return Detail::buildErrorResponse(error, details);
+    }
+}//namespace Utils
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace Utils
+{
+    /**
+     * Thread-safe key/value cache with per-entry expiry. Keys are spread over
+     * independently locked shards so concurrent request threads rarely contend.
+     * When a shard is full, expired entries are dropped first and then an
+     * arbitrary one; this is a cache of recomputable values, not an LRU.
+     */
+    template<typename Key, typename Value, typename Hash = std::hash<Key>, size_t ShardCount = 16>
+    class ExpiringCache
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit ExpiringCache(size_t maxEntries)
+            : m_maxEntriesPerShard(std::max<size_t>(1, maxEntries / ShardCount))
+        {
+        }
+
+        std::optional<Value> get(const Key &key) const
+        {
+            const auto &shard = shardFor(key);
+            std::lock_guard lock(shard.mutex);
+
+            const auto it = shard.entries.find(key);
+            if (it == shard.entries.end() || it->second.expiresAt <= Clock::now())
+            {
+                return std::nullopt;
+            }
+            return it->second.value;
+        }
+
+        void put(const Key &key, Value value, Clock::duration ttl)
+        {
+            auto &shard = shardFor(key);
+            std::lock_guard lock(shard.mutex);
+
+            if (shard.entries.size() >= m_maxEntriesPerShard && !shard.entries.contains(key))
+            {
+                const auto now = Clock::now();
+                std::erase_if(shard.entries, [now](const auto &entry) { return entry.second.expiresAt <= now; });
+                if (shard.entries.size() >= m_maxEntriesPerShard)
+                {
+                    shard.entries.erase(shard.entries.begin());
+                }
+            }
+
+            shard.entries.insert_or_assign(key, Entry{std::move(value), Clock::now() + ttl});
+        }
+
+        void erase(const Key &key)
+        {
+            auto &shard = shardFor(key);
+            std::lock_guard lock(shard.mutex);
+            shard.entries.erase(key);
+        }
+
+        template<typename Predicate>
+        void eraseIf(Predicate &&predicate)
+        {
+            for (auto &shard : m_shards)
+            {
+                std::lock_guard lock(shard.mutex);
+                std::erase_if(shard.entries, [&predicate](const auto &entry) { return predicate(entry.first); });
+            }
+        }
+
+    private:
+        struct Entry
+        {
+            Value value;
+            Clock::time_point expiresAt;
+        };
+
+        struct Shard
+        {
+            mutable std::mutex mutex;
+            std::unordered_map<Key, Entry, Hash> entries;
+        };
+
+        Shard &shardFor(const Key &key) { return m_shards[Hash{}(key) % ShardCount]; }
+        const Shard &shardFor(const Key &key) const { return m_shards[Hash{}(key) % ShardCount]; }
+
+    private:
+        size_t m_maxEntriesPerShard;
+        std::array<Shard, ShardCount> m_shards;
+    };
+}//namespace Utils
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <drogon/HttpFilter.h>
-#include "Utils.hpp"
+#include "JwtVerifier.hpp"
+#include "RevocationList.hpp"
+#include "ErrorResponses.hpp"
+#include "Uuid.hpp"
 using namespace drogon;
 
 class JwtAuthFilter : public HttpFilter<JwtAuthFilter>
@@ -13,39 +16,46 @@ public:
                   FilterCallback &&fcb,
                   FilterChainCallback &&fccb) override
     {
-        auto authHeader = req->getHeader("Authorization");
-        if (authHeader.empty() || authHeader.size() < 8 || authHeader.substr(0, 7) != "Bearer ")
+        const std::string_view authHeader = req->getHeader("Authorization");
+        if (authHeader.size() < 8 || !authHeader.starts_with("Bearer "))
         {
-            auto res = HttpResponse::newHttpResponse();
-            res->setStatusCode(k401Unauthorized);
-            res->setBody("Missing or invalid Authorization header");
-            fcb(res);
+            fcb(Utils::errorResponse(Utils::Error::MissingAuthorization));
             return;
         }
 
-        auto token = authHeader.substr(7);
+        const auto token = authHeader.substr(7);
 
         try
         {
-            auto data = Utils::Jwt::verifyJwt(token);
-
-            req->getAttributes()->insert("userId", data.decoded.get_payload_claim("sub").as_string());
+            auto claims = Utils::Jwt::verifyJwt(token);
+
+            if (Utils::RevocationList::instance().isRevoked(claims.tokenId))
+            {
+                fcb(Utils::errorResponse(Utils::Error::TokenRevoked));
+                return;
+            }
+
+            // User ids are compared as text downstream, so UUIDs are brought to one spelling
+            if (const auto uuid = Utils::Uuid::parse(claims.subject))
+            {
+                claims.subject = uuid->toString();
+            }
+            req->getAttributes()->insert("userId", std::move(claims.subject));
+            req->getAttributes()->insert("tokenId", std::move(claims.tokenId));
+            req->getAttributes()->insert("sessionId", std::move(claims.sessionId));
+            req->getAttributes()->insert("tokenExpiresAt", claims.expiresAt);
 
             fccb();
         }
         catch (const std::exception &e)
         {
-            auto res = HttpResponse::newHttpResponse();
-            res->setStatusCode(k401Unauthorized);
-            res->setBody(std::format("Invalid token: {}", e.what()));
-            fcb(res);
+            // The reason stays in the log, not in the response
+            spdlog::debug("Rejected token: {}", e.what());
+            fcb(Utils::errorResponse(Utils::Error::InvalidToken));
         }
         catch (...)
         {
-            auto res = HttpResponse::newHttpResponse();
-            res->setStatusCode(k401Unauthorized);
-            res->setBody("Unknown error reading authorization token");
-            fcb(res);
+            fcb(Utils::errorResponse(Utils::Error::InvalidToken));
         }
     }
 };
@@ -0,0 +1,572 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <json/json.h>
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/param_build.h>
+#include <drogon/HttpAppFramework.h>
+#include <drogon/HttpClient.h>
+#include <spdlog/spdlog.h>
+#include <jwt-cpp/jwt.h>
+
+namespace Utils::Jwt
+{
+    enum class KeyAlgorithm
+    {
+        EdDSA,
+        ES256
+    };
+
+    inline std::string toString(KeyAlgorithm alg)
+    {
+        switch (alg)
+        {
+            case KeyAlgorithm::EdDSA: return "EdDSA";
+            case KeyAlgorithm::ES256: return "ES256";
+        }
+        return {};
+    }
+
+    namespace Detail
+    {
+        struct PkeyDeleter
+        {
+            void operator()(EVP_PKEY *key) const { EVP_PKEY_free(key); }
+        };
+
+        using PkeyPtr = std::unique_ptr<EVP_PKEY, PkeyDeleter>;
+
+        inline constexpr std::array<int8_t, 256> base64UrlTable = []
+        {
+            std::array<int8_t, 256> table{};
+            table.fill(-1);
+            constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+            for (size_t i = 0; i < alphabet.size(); ++i)
+            {
+                table[static_cast<uint8_t>(alphabet[i])] = static_cast<int8_t>(i);
+            }
+            return table;
+        }();
+
+        // Decodes unpadded base64url into `out`, reusing its capacity. Every value
+        // has exactly one encoding: padding, a dangling character and non-zero
+        // leftover bits are rejected, so a signature can not be altered and still
+        // verify.
+        inline bool decodeBase64Url(std::string_view in, std::string &out)
+        {
+            out.clear();
+            if (in.size() % 4 == 1)
+            {
+                return false;
+            }
+            out.reserve(in.size() * 3 / 4 + 3);
+
+            uint32_t acc = 0;
+            int bits = 0;
+            for (char c : in)
+            {
+                const auto v = base64UrlTable[static_cast<uint8_t>(c)];
+                if (v < 0)
+                {
+                    return false;
+                }
+                acc = (acc << 6) | static_cast<uint32_t>(v);
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    out.push_back(static_cast<char>((acc >> bits) & 0xFF));
+                }
+            }
+            return (acc & ((1u << bits) - 1)) == 0;
+        }
+
+        inline std::string encodeBase64Url(std::string_view in)
+        {
+            constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+            std::string out;
+            out.reserve((in.size() * 4 + 2) / 3);
+
+            uint32_t acc = 0;
+            int bits = 0;
+            for (unsigned char c : in)
+            {
+                acc = (acc << 8) | c;
+                bits += 8;
+                while (bits >= 6)
+                {
+                    bits -= 6;
+                    out.push_back(alphabet[(acc >> bits) & 0x3F]);
+                }
+            }
+            if (bits > 0)
+            {
+                out.push_back(alphabet[(acc << (6 - bits)) & 0x3F]);
+            }
+            return out;
+        }
+
+        inline std::string decodeMember(const Json::Value &jwk, const char *name, size_t expectedSize)
+        {
+            std::string out;
+            if (!jwk[name].isString() || !decodeBase64Url(jwk[name].asString(), out) || out.size() != expectedSize)
+            {
+                throw std::runtime_error(std::format("JWK member '{}' is missing or malformed", name));
+            }
+            return out;
+        }
+
+        inline PkeyPtr ed25519FromJwk(const Json::Value &jwk)
+        {
+            EVP_PKEY *key = nullptr;
+            if (jwk.isMember("d"))
+            {
+                const auto d = decodeMember(jwk, "d", 32);
+                key = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr,
+                                                   reinterpret_cast<const unsigned char *>(d.data()), d.size());
+            }
+            else
+            {
+                const auto x = decodeMember(jwk, "x", 32);
+                key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr,
+                                                  reinterpret_cast<const unsigned char *>(x.data()), x.size());
+            }
+
+            if (!key)
+            {
+                throw std::runtime_error("Error creating Ed25519 key");
+            }
+            return PkeyPtr{key};
+        }
+
+        inline PkeyPtr p256FromJwk(const Json::Value &jwk)
+        {
+            const auto x = decodeMember(jwk, "x", 32);
+            const auto y = decodeMember(jwk, "y", 32);
+            const bool isPrivate = jwk.isMember("d");
+
+            std::string publicPoint;
+            publicPoint.reserve(65);
+            publicPoint.push_back(0x04);
+            publicPoint += x;
+            publicPoint += y;
+
+            std::unique_ptr<OSSL_PARAM_BLD, decltype(&OSSL_PARAM_BLD_free)> builder{OSSL_PARAM_BLD_new(), &OSSL_PARAM_BLD_free};
+            std::unique_ptr<BIGNUM, decltype(&BN_clear_free)> privateNumber{nullptr, &BN_clear_free};
+            if (isPrivate)
+            {
+                const auto d = decodeMember(jwk, "d", 32);
+                privateNumber.reset(BN_bin2bn(reinterpret_cast<const unsigned char *>(d.data()), static_cast<int>(d.size()), nullptr));
+            }
+
+            if (!builder ||
+                OSSL_PARAM_BLD_push_utf8_string(builder.get(), OSSL_PKEY_PARAM_GROUP_NAME, "prime256v1", 0) != 1 ||
+                OSSL_PARAM_BLD_push_octet_string(builder.get(), OSSL_PKEY_PARAM_PUB_KEY, publicPoint.data(), publicPoint.size()) != 1 ||
+                (isPrivate && (!privateNumber || OSSL_PARAM_BLD_push_BN(builder.get(), OSSL_PKEY_PARAM_PRIV_KEY, privateNumber.get()) != 1)))
+            {
+                throw std::runtime_error("Error building P-256 key parameters");
+            }
+
+            std::unique_ptr<OSSL_PARAM, decltype(&OSSL_PARAM_free)> params{OSSL_PARAM_BLD_to_param(builder.get()), &OSSL_PARAM_free};
+            std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx{EVP_PKEY_CTX_new_from_name(nullptr, "EC", nullptr), &EVP_PKEY_CTX_free};
+
+            EVP_PKEY *key = nullptr;
+            if (!params || !ctx ||
+                EVP_PKEY_fromdata_init(ctx.get()) != 1 ||
+                EVP_PKEY_fromdata(ctx.get(), &key, isPrivate ? EVP_PKEY_KEYPAIR : EVP_PKEY_PUBLIC_KEY, params.get()) != 1)
+            {
+                throw std::runtime_error("Error creating P-256 key");
+            }
+            return PkeyPtr{key};
+        }
+    }//namespace Detail
+
+    /**
+     * One JWK usable for EdDSA (Ed25519) or ES256 (P-256). Keys loaded with a
+     * private part can also sign.
+     */
+    class Key
+    {
+    public:
+        Key(std::string kid, KeyAlgorithm alg, Detail::PkeyPtr key, bool isPrivate)
+            : m_kid(std::move(kid))
+            , m_alg(alg)
+            , m_key(std::move(key))
+            , m_isPrivate(isPrivate)
+        {
+        }
+
+        const std::string &kid() const { return m_kid; }
+        KeyAlgorithm algorithm() const { return m_alg; }
+        bool canSign() const { return m_isPrivate; }
+
+        // Verifies a JOSE signature. `ctx` is a caller-owned context reused across calls.
+        bool verify(EVP_MD_CTX *ctx, std::string_view data, std::string_view signature) const
+        {
+            EVP_MD_CTX_reset(ctx);
+
+            if (m_alg == KeyAlgorithm::EdDSA)
+            {
+                return EVP_DigestVerifyInit(ctx, nullptr, nullptr, nullptr, m_key.get()) == 1 &&
+                       EVP_DigestVerify(ctx,
+                                        reinterpret_cast<const unsigned char *>(signature.data()), signature.size(),
+                                        reinterpret_cast<const unsigned char *>(data.data()), data.size()) == 1;
+            }
+
+            // JOSE carries ES256 signatures as raw r || s, OpenSSL expects DER
+            if (signature.size() != 64)
+            {
+                return false;
+            }
+
+            std::unique_ptr<ECDSA_SIG, decltype(&ECDSA_SIG_free)> sig{ECDSA_SIG_new(), &ECDSA_SIG_free};
+            auto *r = BN_bin2bn(reinterpret_cast<const unsigned char *>(signature.data()), 32, nullptr);
+            auto *s = BN_bin2bn(reinterpret_cast<const unsigned char *>(signature.data()) + 32, 32, nullptr);
+            if (!sig || !r || !s || ECDSA_SIG_set0(sig.get(), r, s) != 1)
+            {
+                BN_free(r);
+                BN_free(s);
+                return false;
+            }
+
+            std::array<unsigned char, 80> der;
+            auto *derEnd = der.data();
+            const auto derLength = i2d_ECDSA_SIG(sig.get(), &derEnd);
+            if (derLength <= 0)
+            {
+                return false;
+            }
+
+            return EVP_DigestVerifyInit(ctx, nullptr, EVP_sha256(), nullptr, m_key.get()) == 1 &&
+                   EVP_DigestVerify(ctx, der.data(), static_cast<size_t>(derLength),
+                                    reinterpret_cast<const unsigned char *>(data.data()), data.size()) == 1;
+        }
+
+        std::string sign(std::string_view data) const
+        {
+            if (!m_isPrivate)
+            {
+                throw std::runtime_error(std::format("Key '{}' has no private part", m_kid));
+            }
+
+            std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx{EVP_MD_CTX_new(), &EVP_MD_CTX_free};
+            const EVP_MD *md = m_alg == KeyAlgorithm::EdDSA ? nullptr : EVP_sha256();
+
+            size_t length = 0;
+            if (!ctx ||
+                EVP_DigestSignInit(ctx.get(), nullptr, md, nullptr, m_key.get()) != 1 ||
+                EVP_DigestSign(ctx.get(), nullptr, &length, reinterpret_cast<const unsigned char *>(data.data()), data.size()) != 1)
+            {
+                throw std::runtime_error("Error initializing token signing");
+            }
+
+            std::string signature(length, '\0');
+            if (EVP_DigestSign(ctx.get(), reinterpret_cast<unsigned char *>(signature.data()), &length,
+                               reinterpret_cast<const unsigned char *>(data.data()), data.size()) != 1)
+            {
+                throw std::runtime_error("Error signing token");
+            }
+            signature.resize(length);
+
+            if (m_alg == KeyAlgorithm::EdDSA)
+            {
+                return signature;
+            }
+
+            const auto *derBegin = reinterpret_cast<const unsigned char *>(signature.data());
+            std::unique_ptr<ECDSA_SIG, decltype(&ECDSA_SIG_free)> sig{d2i_ECDSA_SIG(nullptr, &derBegin, static_cast<long>(signature.size())), &ECDSA_SIG_free};
+            if (!sig)
+            {
+                throw std::runtime_error("Error decoding ECDSA signature");
+            }
+
+            std::string raw(64, '\0');
+            if (BN_bn2binpad(ECDSA_SIG_get0_r(sig.get()), reinterpret_cast<unsigned char *>(raw.data()), 32) != 32 ||
+                BN_bn2binpad(ECDSA_SIG_get0_s(sig.get()), reinterpret_cast<unsigned char *>(raw.data()) + 32, 32) != 32)
+            {
+                throw std::runtime_error("Error encoding ECDSA signature");
+            }
+            return raw;
+        }
+
+    private:
+        std::string m_kid;
+        KeyAlgorithm m_alg;
+        Detail::PkeyPtr m_key;
+        bool m_isPrivate;
+    };
+
+    /**
+     * Adapter that lets jwt-cpp's builder sign with a `Key`.
+     */
+    struct KeySigner
+    {
+        const Key &key;
+
+        std::string name() const { return toString(key.algorithm()); }
+
+        std::string sign(const std::string &data, std::error_code &ec) const
+        {
+            try
+            {
+                return key.sign(data);
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::error("JWT signing error: {}", e.what());
+                ec = jwt::error::signature_generation_error::signfinal_failed;
+                return {};
+            }
+        }
+
+        void verify(const std::string &data, const std::string &signature, std::error_code &ec) const
+        {
+            std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx{EVP_MD_CTX_new(), &EVP_MD_CTX_free};
+            if (!ctx || !key.verify(ctx.get(), data, signature))
+            {
+                ec = jwt::error::signature_verification_error::invalid_signature;
+            }
+        }
+    };
+
+    /**
+     * Immutable set of keys parsed from a JWKS document. The first key that has a
+     * private part is the active signing key, so rotation is: prepend the new key,
+     * keep the old public key in the set until its tokens expire, then drop it.
+     */
+    class KeySet
+    {
+    public:
+        static std::shared_ptr<const KeySet> fromJwks(const std::string &document)
+        {
+            Json::Value root;
+            Json::CharReaderBuilder builder;
+            std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+            std::string errors;
+            if (!reader->parse(document.data(), document.data() + document.size(), &root, &errors))
+            {
+                throw std::runtime_error("Error parsing JWKS: " + errors);
+            }
+            if (!root["keys"].isArray())
+            {
+                throw std::runtime_error("JWKS has no 'keys' array");
+            }
+
+            auto keySet = std::make_shared<KeySet>();
+            keySet->m_publicJwks["keys"] = Json::arrayValue;
+
+            for (const auto &jwk : root["keys"])
+            {
+                const auto kid = jwk["kid"].asString();
+                const auto kty = jwk["kty"].asString();
+                const auto crv = jwk["crv"].asString();
+                if (kid.empty())
+                {
+                    throw std::runtime_error("JWK without 'kid'");
+                }
+
+                std::shared_ptr<const Key> key;
+                if (kty == "OKP" && crv == "Ed25519")
+                {
+                    key = std::make_shared<Key>(kid, KeyAlgorithm::EdDSA, Detail::ed25519FromJwk(jwk), jwk.isMember("d"));
+                }
+                else if (kty == "EC" && crv == "P-256")
+                {
+                    key = std::make_shared<Key>(kid, KeyAlgorithm::ES256, Detail::p256FromJwk(jwk), jwk.isMember("d"));
+                }
+                else
+                {
+                    spdlog::warn("Skipping JWK '{}' with unsupported type {}/{}", kid, kty, crv);
+                    continue;
+                }
+
+                if (key->canSign() && !keySet->m_signingKey)
+                {
+                    keySet->m_signingKey = key;
+                }
+
+                auto publicJwk = jwk;
+                publicJwk.removeMember("d");
+                publicJwk["alg"] = toString(key->algorithm());
+                keySet->m_publicJwks["keys"].append(std::move(publicJwk));
+                keySet->m_keys.emplace(kid, std::move(key));
+            }
+
+            return keySet;
+        }
+
+        const Key *find(std::string_view kid) const
+        {
+            const auto it = m_keys.find(std::string(kid));
+            return it != m_keys.end() ? it->second.get() : nullptr;
+        }
+
+        const Key *signingKey() const { return m_signingKey.get(); }
+        const Json::Value &publicJwks() const { return m_publicJwks; }
+
+    private:
+        std::unordered_map<std::string, std::shared_ptr<const Key>> m_keys;
+        std::shared_ptr<const Key> m_signingKey;
+        Json::Value m_publicJwks;
+    };
+
+    /**
+     * Process-wide holder of the current `KeySet`. Readers compare `generation()`
+     * with the one they cached and only take the lock when the set was replaced.
+     */
+    class KeyStore
+    {
+    public:
+        static KeyStore &instance()
+        {
+            static KeyStore store;
+            return store;
+        }
+
+        uint64_t generation() const { return m_generation.load(std::memory_order_acquire); }
+
+        std::shared_ptr<const KeySet> snapshot() const
+        {
+            std::lock_guard lock(m_mutex);
+            return m_current;
+        }
+
+        void load(const std::string &document)
+        {
+            auto keySet = KeySet::fromJwks(document);
+            {
+                std::lock_guard lock(m_mutex);
+                m_current = std::move(keySet);
+            }
+            m_generation.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        // Loads `path` now and then reloads it whenever its mtime changes.
+        void watchFile(std::string path, std::chrono::seconds interval)
+        {
+            reloadFile(path);
+            drogon::app().getLoop()->runEvery(static_cast<double>(interval.count()), [this, path = std::move(path)]
+            {
+                reloadFile(path);
+            });
+        }
+
+        // Periodically fetches a JWKS document, e.g. auth-service's /.well-known/jwks.json.
+        void watchUrl(const std::string &url, std::chrono::seconds interval)
+        {
+            const auto pathStart = url.find('/', url.find("://") + 3);
+            m_client = drogon::HttpClient::newHttpClient(url.substr(0, pathStart), drogon::app().getLoop());
+            m_urlPath = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+            drogon::app().getLoop()->queueInLoop([this] { fetchUrl(); });
+            drogon::app().getLoop()->runEvery(static_cast<double>(interval.count()), [this] { fetchUrl(); });
+        }
+
+        // Called when a token names an unknown kid: refetch early, at most once per interval.
+        void requestRefresh()
+        {
+            if (!m_client)
+            {
+                return;
+            }
+
+            const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+            auto last = m_lastForcedRefresh.load(std::memory_order_relaxed);
+            if (now - last < std::chrono::steady_clock::duration(std::chrono::seconds{10}).count() ||
+                !m_lastForcedRefresh.compare_exchange_strong(last, now))
+            {
+                return;
+            }
+
+            drogon::app().getLoop()->queueInLoop([this] { fetchUrl(); });
+        }
+
+    private:
+        KeyStore() = default;
+
+        void reloadFile(const std::string &path)
+        {
+            std::error_code ec;
+            const auto mtime = std::filesystem::last_write_time(path, ec);
+            if (ec)
+            {
+                spdlog::error("Error reading JWT keys file {}: {}", path, ec.message());
+                return;
+            }
+            if (mtime == m_fileMtime)
+            {
+                return;
+            }
+
+            try
+            {
+                std::ifstream file(path);
+                std::stringstream content;
+                content << file.rdbuf();
+                load(content.str());
+                m_fileMtime = mtime;
+                spdlog::info("Loaded JWT keys from {}", path);
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::error("Error loading JWT keys from {}: {}", path, e.what());
+            }
+        }
+
+        void fetchUrl()
+        {
+            auto req = drogon::HttpRequest::newHttpRequest();
+            req->setPath(m_urlPath);
+            m_client->sendRequest(req, [this](drogon::ReqResult result, const drogon::HttpResponsePtr &resp)
+            {
+                if (result != drogon::ReqResult::Ok || !resp || resp->statusCode() != drogon::k200OK)
+                {
+                    spdlog::error("Error fetching JWKS from {}{}", m_client->getHost(), m_urlPath);
+                    return;
+                }
+
+                const auto body = std::string(resp->body());
+                if (body == m_lastDocument)
+                {
+                    return;
+                }
+
+                try
+                {
+                    load(body);
+                    m_lastDocument = body;
+                    spdlog::info("Loaded JWKS from {}{}", m_client->getHost(), m_urlPath);
+                }
+                catch (const std::exception &e)
+                {
+                    spdlog::error("Error loading JWKS: {}", e.what());
+                }
+            });
+        }
+
+    private:
+        mutable std::mutex m_mutex;
+        std::shared_ptr<const KeySet> m_current;
+        std::atomic<uint64_t> m_generation{0};
+
+        std::filesystem::file_time_type m_fileMtime{};
+        drogon::HttpClientPtr m_client;
+        std::string m_urlPath;
+        std::string m_lastDocument;
+        std::atomic<int64_t> m_lastForcedRefresh{0};
+    };
+}//namespace Utils::Jwt
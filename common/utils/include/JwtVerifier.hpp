@@ -0,0 +1,449 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <config.hpp>
+#include "Utils.hpp"
+#include "JwtKeys.hpp"
+
+namespace Utils::Jwt
+{
+    struct Claims
+    {
+        TokenType type = TokenType::ACCESS;
+        std::string subject;
+        std::string tokenId;
+        std::string sessionId;
+        int64_t expiresAt = 0;
+    };
+
+    namespace Detail
+    {
+        /**
+         * Minimal reader for the flat JSON objects our own tokens carry (string and
+         * integer members only). Anything else - nested values, escapes, floats -
+         * makes `read` return false, and the caller falls back to picojson.
+         */
+        struct FlatClaims
+        {
+            std::string_view alg;
+            std::string_view kid;
+            std::string_view iss;
+            std::string_view sub;
+            std::string_view type;
+            std::string_view jti;
+            std::string_view sid;
+            std::optional<int64_t> exp;
+            std::optional<int64_t> nbf;
+            std::optional<int64_t> iat;
+
+            bool read(std::string_view json)
+            {
+                size_t pos = 0;
+                const auto skipWs = [&]
+                {
+                    while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == '\t' || json[pos] == '\r'))
+                    {
+                        ++pos;
+                    }
+                };
+                const auto readString = [&](std::string_view &dst)
+                {
+                    if (pos >= json.size() || json[pos] != '"')
+                    {
+                        return false;
+                    }
+                    const auto end = json.find_first_of("\"\\", pos + 1);
+                    if (end == std::string_view::npos || json[end] != '"')
+                    {
+                        return false;
+                    }
+                    dst = json.substr(pos + 1, end - pos - 1);
+                    pos = end + 1;
+                    return true;
+                };
+
+                skipWs();
+                if (pos >= json.size() || json[pos++] != '{')
+                {
+                    return false;
+                }
+
+                skipWs();
+                if (pos < json.size() && json[pos] == '}')
+                {
+                    return true;
+                }
+
+                while (pos < json.size())
+                {
+                    std::string_view key;
+                    skipWs();
+                    if (!readString(key))
+                    {
+                        return false;
+                    }
+                    skipWs();
+                    if (pos >= json.size() || json[pos++] != ':')
+                    {
+                        return false;
+                    }
+                    skipWs();
+                    if (pos >= json.size())
+                    {
+                        return false;
+                    }
+
+                    if (json[pos] == '"')
+                    {
+                        std::string_view value;
+                        if (!readString(value))
+                        {
+                            return false;
+                        }
+                        if (key == "alg") alg = value;
+                        else if (key == "kid") kid = value;
+                        else if (key == "iss") iss = value;
+                        else if (key == "sub") sub = value;
+                        else if (key == "type") type = value;
+                        else if (key == "jti") jti = value;
+                        else if (key == "sid") sid = value;
+                    }
+                    else
+                    {
+                        int64_t value = 0;
+                        const auto [ptr, ec] = std::from_chars(json.data() + pos, json.data() + json.size(), value);
+                        if (ec != std::errc{})
+                        {
+                            return false;
+                        }
+                        pos = ptr - json.data();
+                        if (pos < json.size() && (json[pos] == '.' || json[pos] == 'e' || json[pos] == 'E'))
+                        {
+                            return false;
+                        }
+                        if (key == "exp") exp = value;
+                        else if (key == "nbf") nbf = value;
+                        else if (key == "iat") iat = value;
+                    }
+
+                    skipWs();
+                    if (pos >= json.size())
+                    {
+                        return false;
+                    }
+                    if (json[pos] == '}')
+                    {
+                        return true;
+                    }
+                    if (json[pos++] != ',')
+                    {
+                        return false;
+                    }
+                }
+                return false;
+            }
+        };
+    }//namespace Detail
+
+    /**
+     * Token verifier for EdDSA/ES256 tokens (public key looked up by `kid` in the
+     * `KeyStore`) and legacy HS256 tokens. For HS256 the HMAC key schedule is
+     * computed once: the inner and outer padded-key SHA-256 states are kept and
+     * copied for each token, so no allocations happen in the steady state.
+     * Instances are not thread-safe; use `forThisThread()`.
+     */
+    class Verifier
+    {
+    public:
+        explicit Verifier(std::string_view secret)
+            : m_inner(EVP_MD_CTX_new())
+            , m_outer(EVP_MD_CTX_new())
+            , m_work(EVP_MD_CTX_new())
+            , m_keyStore(KeyStore::instance())
+        {
+            if (!m_inner || !m_outer || !m_work)
+            {
+                throw std::runtime_error("Error allocating digest context");
+            }
+
+            constexpr size_t blockSize = 64;
+            std::array<unsigned char, blockSize> key{};
+            if (secret.size() > blockSize)
+            {
+                unsigned int keyLength = 0;
+                EVP_Digest(secret.data(), secret.size(), key.data(), &keyLength, EVP_sha256(), nullptr);
+            }
+            else
+            {
+                std::copy(secret.begin(), secret.end(), key.begin());
+            }
+
+            std::array<unsigned char, blockSize> ipad;
+            std::array<unsigned char, blockSize> opad;
+            for (size_t i = 0; i < blockSize; ++i)
+            {
+                ipad[i] = key[i] ^ 0x36;
+                opad[i] = key[i] ^ 0x5c;
+            }
+            OPENSSL_cleanse(key.data(), key.size());
+
+            if (EVP_DigestInit_ex(m_inner, EVP_sha256(), nullptr) != 1 ||
+                EVP_DigestUpdate(m_inner, ipad.data(), ipad.size()) != 1 ||
+                EVP_DigestInit_ex(m_outer, EVP_sha256(), nullptr) != 1 ||
+                EVP_DigestUpdate(m_outer, opad.data(), opad.size()) != 1)
+            {
+                throw std::runtime_error("Error initializing HMAC state");
+            }
+            OPENSSL_cleanse(ipad.data(), ipad.size());
+            OPENSSL_cleanse(opad.data(), opad.size());
+        }
+
+        ~Verifier()
+        {
+            EVP_MD_CTX_free(m_inner);
+            EVP_MD_CTX_free(m_outer);
+            EVP_MD_CTX_free(m_work);
+        }
+
+        Verifier(const Verifier&) = delete;
+        Verifier& operator=(const Verifier&) = delete;
+
+        static Verifier& forThisThread()
+        {
+            thread_local Verifier verifier{Config::jwtSecretKey};
+            return verifier;
+        }
+
+        Claims verify(std::string_view token)
+        {
+            const auto firstDot = token.find('.');
+            const auto secondDot = token.find('.', firstDot + 1);
+            if (firstDot == std::string_view::npos || secondDot == std::string_view::npos ||
+                token.find('.', secondDot + 1) != std::string_view::npos)
+            {
+                throw std::runtime_error("Malformed token");
+            }
+
+            const auto header = token.substr(0, firstDot);
+            const auto payload = token.substr(firstDot + 1, secondDot - firstDot - 1);
+            const auto signature = token.substr(secondDot + 1);
+
+            verifyHeader(header);
+            if (m_headerAlg == Algorithm::HS256)
+            {
+                verifyHmacSignature(token.substr(0, secondDot), signature);
+            }
+            else
+            {
+                verifyKeySignature(token.substr(0, secondDot), signature);
+            }
+
+            if (!Detail::decodeBase64Url(payload, m_buffer))
+            {
+                throw std::runtime_error("Malformed token payload");
+            }
+
+            Detail::FlatClaims flat;
+            if (!flat.read(m_buffer))
+            {
+                return claimsFromPicojson(m_buffer);
+            }
+
+            return makeClaims(flat.iss, flat.sub, flat.type, flat.jti, flat.sid, flat.exp, flat.nbf, flat.iat);
+        }
+
+    private:
+        enum class Algorithm
+        {
+            HS256,
+            EdDSA,
+            ES256
+        };
+
+        void verifyHeader(std::string_view header)
+        {
+            // Tokens signed with the same key share one header, so after the first
+            // one is parsed the rest are a plain comparison.
+            if (!m_lastHeader.empty() && header == m_lastHeader)
+            {
+                return;
+            }
+
+            Detail::FlatClaims flat;
+            if (!Detail::decodeBase64Url(header, m_buffer) || !flat.read(m_buffer))
+            {
+                throw std::runtime_error("Malformed token header");
+            }
+
+            if (flat.alg == "EdDSA")
+            {
+                m_headerAlg = Algorithm::EdDSA;
+            }
+            else if (flat.alg == "ES256")
+            {
+                m_headerAlg = Algorithm::ES256;
+            }
+            else if (flat.alg == "HS256" && Config::jwtAllowHs256)
+            {
+                m_headerAlg = Algorithm::HS256;
+            }
+            else
+            {
+                m_lastHeader.clear();
+                throw std::runtime_error("Token algorithm is not allowed");
+            }
+
+            m_headerKid.assign(flat.kid);
+            m_lastHeader.assign(header);
+        }
+
+        void verifyKeySignature(std::string_view signingInput, std::string_view signature)
+        {
+            if (const auto generation = m_keyStore.generation(); generation != m_keysGeneration)
+            {
+                m_keys = m_keyStore.snapshot();
+                m_keysGeneration = generation;
+            }
+
+            const auto *key = m_keys ? m_keys->find(m_headerKid) : nullptr;
+            if (!key)
+            {
+                m_keyStore.requestRefresh();
+                throw std::runtime_error("Unknown token key id");
+            }
+
+            const auto expected = m_headerAlg == Algorithm::EdDSA ? KeyAlgorithm::EdDSA : KeyAlgorithm::ES256;
+            if (key->algorithm() != expected)
+            {
+                throw std::runtime_error("Token algorithm does not match its key");
+            }
+
+            if (!Detail::decodeBase64Url(signature, m_buffer) || !key->verify(m_work, signingInput, m_buffer))
+            {
+                throw std::runtime_error("Invalid token signature");
+            }
+        }
+
+        void verifyHmacSignature(std::string_view signingInput, std::string_view signature)
+        {
+            std::array<unsigned char, EVP_MAX_MD_SIZE> innerHash;
+            std::array<unsigned char, EVP_MAX_MD_SIZE> mac;
+            unsigned int innerLength = 0;
+            unsigned int macLength = 0;
+
+            if (EVP_MD_CTX_copy_ex(m_work, m_inner) != 1 ||
+                EVP_DigestUpdate(m_work, signingInput.data(), signingInput.size()) != 1 ||
+                EVP_DigestFinal_ex(m_work, innerHash.data(), &innerLength) != 1 ||
+                EVP_MD_CTX_copy_ex(m_work, m_outer) != 1 ||
+                EVP_DigestUpdate(m_work, innerHash.data(), innerLength) != 1 ||
+                EVP_DigestFinal_ex(m_work, mac.data(), &macLength) != 1)
+            {
+                throw std::runtime_error("Error computing token signature");
+            }
+
+            if (!Detail::decodeBase64Url(signature, m_buffer) ||
+                m_buffer.size() != macLength ||
+                CRYPTO_memcmp(m_buffer.data(), mac.data(), macLength) != 0)
+            {
+                throw std::runtime_error("Invalid token signature");
+            }
+        }
+
+        static Claims claimsFromPicojson(const std::string &json)
+        {
+            picojson::value value;
+            const auto error = picojson::parse(value, json);
+            if (!error.empty() || !value.is<picojson::object>())
+            {
+                throw std::runtime_error("Malformed token payload");
+            }
+
+            const auto &object = value.get<picojson::object>();
+            const auto string = [&](const char *name) -> std::string_view
+            {
+                const auto it = object.find(name);
+                return it != object.end() && it->second.is<std::string>() ? std::string_view(it->second.get<std::string>()) : std::string_view{};
+            };
+            const auto integer = [&](const char *name) -> std::optional<int64_t>
+            {
+                const auto it = object.find(name);
+                if (it == object.end() || !it->second.is<int64_t>())
+                {
+                    return std::nullopt;
+                }
+                return it->second.get<int64_t>();
+            };
+
+            return makeClaims(string("iss"), string("sub"), string("type"), string("jti"), string("sid"), integer("exp"), integer("nbf"), integer("iat"));
+        }
+
+        static Claims makeClaims(std::string_view iss,
+                                 std::string_view sub,
+                                 std::string_view type,
+                                 std::string_view jti,
+                                 std::string_view sid,
+                                 std::optional<int64_t> exp,
+                                 std::optional<int64_t> nbf,
+                                 std::optional<int64_t> iat)
+        {
+            using namespace std::chrono;
+            const auto now = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+
+            if (iss != "auth-service")
+            {
+                throw std::runtime_error("Token issuer is not allowed");
+            }
+            if (exp && *exp <= now)
+            {
+                throw std::runtime_error("Token expired");
+            }
+            if ((nbf && *nbf > now) || (iat && *iat > now))
+            {
+                throw std::runtime_error("Token is not valid yet");
+            }
+            if (sub.empty())
+            {
+                throw std::runtime_error("User id is not present in token");
+            }
+
+            Claims claims;
+            if (!fromString(type, claims.type))
+            {
+                throw std::runtime_error("Error getting token type");
+            }
+            claims.subject.assign(sub);
+            claims.tokenId.assign(jti);
+            claims.sessionId.assign(sid);
+            claims.expiresAt = exp.value_or(0);
+
+            return claims;
+        }
+
+    private:
+        EVP_MD_CTX *m_inner;
+        EVP_MD_CTX *m_outer;
+        EVP_MD_CTX *m_work;
+        std::string m_buffer;
+
+        std::string m_lastHeader;
+        Algorithm m_headerAlg = Algorithm::HS256;
+        std::string m_headerKid;
+
+        KeyStore &m_keyStore;
+        std::shared_ptr<const KeySet> m_keys;
+        uint64_t m_keysGeneration = 0;
+    };
+
+    inline Claims verifyJwt(std::string_view token)
+    {
+        return Verifier::forThisThread().verify(token);
+    }
+}//namespace Utils::Jwt
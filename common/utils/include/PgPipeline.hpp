@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <libpq-fe.h>
+#include <drogon/utils/coroutine.h>
+#include "Coro.hpp"
+
+namespace Utils
+{
+    /**
+     * Sends a list of statements in libpq pipeline mode: every statement goes out
+     * before the first result is read, so the batch costs one network round trip
+     * instead of one per statement. With `Mode::Independent` each statement is its
+     * own implicit transaction and a failure affects only that statement; with
+     * `Mode::Atomic` they share one, and a failure aborts the statements after it
+     * and rolls back the ones before.
+     *
+     * Statements run over libpq connections kept apart from drogon's pools, a few
+     * idle ones per connection string. libpq is blocking, so `run` hands the work
+     * to the worker pool. Results are read only after everything is sent, so keep
+     * pipelines to tens of statements.
+     */
+    class PgPipeline
+    {
+    public:
+        enum class Mode
+        {
+            Independent,
+            Atomic,
+        };
+
+        class Result
+        {
+        public:
+            explicit Result(PGresult *result)
+                : m_result(result, PQclear)
+            {
+            }
+
+            bool ok() const
+            {
+                const auto status = PQresultStatus(m_result.get());
+                return status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+            }
+
+            // Empty for a statement skipped after an earlier failure in an atomic pipeline
+            std::string error() const { return PQresultErrorMessage(m_result.get()); }
+            // SQLSTATE of a failed statement, e.g. "23505" for a unique violation
+            std::string sqlState() const
+            {
+                const char *state = PQresultErrorField(m_result.get(), PG_DIAG_SQLSTATE);
+                return state ? state : "";
+            }
+
+            int rows() const { return PQntuples(m_result.get()); }
+            size_t affectedRows() const { return std::strtoull(PQcmdTuples(m_result.get()), nullptr, 10); }
+
+            std::optional<std::string_view> get(int row, const char *column) const
+            {
+                const int col = PQfnumber(m_result.get(), column);
+                if (col < 0 || PQgetisnull(m_result.get(), row, col))
+                {
+                    return std::nullopt;
+                }
+                return std::string_view(PQgetvalue(m_result.get(), row, col), PQgetlength(m_result.get(), row, col));
+            }
+
+        private:
+            std::shared_ptr<PGresult> m_result;
+        };
+
+        explicit PgPipeline(std::string connectionInfo, Mode mode = Mode::Independent)
+            : m_connectionInfo(std::move(connectionInfo))
+            , m_mode(mode)
+        {
+        }
+
+        // Queues a statement; parameters are sent as text, null for SQL NULL. Returns its index in the results.
+        size_t add(std::string sql, std::vector<std::optional<std::string>> params = {})
+        {
+            m_statements.push_back({std::move(sql), std::move(params)});
+            return m_statements.size() - 1;
+        }
+
+        size_t size() const { return m_statements.size(); }
+
+        /**
+         * Runs the queued statements and returns one result per statement, in
+         * order. Throws std::runtime_error when the connection fails; errors of
+         * single statements are reported in their results.
+         */
+        drogon::Task<std::vector<Result>> run()
+        {
+            co_return co_await Coro::runOnWorker([this] { return runBlocking(); });
+        }
+
+    private:
+        struct Statement
+        {
+            std::string sql;
+            std::vector<std::optional<std::string>> params;
+        };
+
+        using Connection = std::unique_ptr<PGconn, decltype(&PQfinish)>;
+
+        // Idle connections per connection string
+        class Pool
+        {
+        public:
+            static constexpr size_t maxIdle = 4;
+
+            static Pool &instance()
+            {
+                static Pool pool;
+                return pool;
+            }
+
+            Connection acquire(const std::string &connectionInfo)
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    auto &idle = m_idle[connectionInfo];
+                    while (!idle.empty())
+                    {
+                        auto conn = std::move(idle.back());
+                        idle.pop_back();
+                        if (PQstatus(conn.get()) == CONNECTION_OK)
+                        {
+                            return conn;
+                        }
+                    }
+                }
+
+                Connection conn(PQconnectdb(connectionInfo.c_str()), PQfinish);
+                if (PQstatus(conn.get()) != CONNECTION_OK)
+                {
+                    throw std::runtime_error(std::string("Pipeline connection failed: ") + PQerrorMessage(conn.get()));
+                }
+                return conn;
+            }
+
+            void release(const std::string &connectionInfo, Connection conn)
+            {
+                std::lock_guard lock(m_mutex);
+                auto &idle = m_idle[connectionInfo];
+                if (idle.size() < maxIdle && PQstatus(conn.get()) == CONNECTION_OK)
+                {
+                    idle.push_back(std::move(conn));
+                }
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::unordered_map<std::string, std::vector<Connection>> m_idle;
+        };
+
+        std::vector<Result> runBlocking()
+        {
+            auto conn = Pool::instance().acquire(m_connectionInfo);
+            auto *pg = conn.get();
+
+            const auto fail = [pg](const char *what)
+            {
+                return std::runtime_error(std::string(what) + ": " + PQerrorMessage(pg));
+            };
+
+            if (!PQenterPipelineMode(pg))
+            {
+                throw fail("Entering pipeline mode failed");
+            }
+
+            std::vector<const char *> values;
+            for (const auto &statement : m_statements)
+            {
+                values.clear();
+                for (const auto &param : statement.params)
+                {
+                    values.push_back(param ? param->c_str() : nullptr);
+                }
+                if (!PQsendQueryParams(pg, statement.sql.c_str(), static_cast<int>(values.size()), nullptr, values.data(), nullptr, nullptr, 0))
+                {
+                    throw fail("Queueing pipeline statement failed");
+                }
+                if (m_mode == Mode::Independent && !PQpipelineSync(pg))
+                {
+                    throw fail("Pipeline sync failed");
+                }
+            }
+            // The sync also flushes everything queued to the server
+            if (m_mode == Mode::Atomic && !PQpipelineSync(pg))
+            {
+                throw fail("Pipeline sync failed");
+            }
+
+            // Every statement yields its result followed by a null, and every sync
+            // a PGRES_PIPELINE_SYNC result
+            std::vector<Result> results;
+            results.reserve(m_statements.size());
+            for (size_t i = 0; i < m_statements.size(); ++i)
+            {
+                auto *result = PQgetResult(pg);
+                if (result == nullptr)
+                {
+                    throw fail("Pipeline ended early");
+                }
+                results.emplace_back(result);
+                while (auto *extra = PQgetResult(pg))
+                {
+                    PQclear(extra);
+                }
+                if (m_mode == Mode::Independent)
+                {
+                    readSync(pg);
+                }
+            }
+            if (m_mode == Mode::Atomic)
+            {
+                readSync(pg);
+            }
+
+            if (!PQexitPipelineMode(pg))
+            {
+                throw fail("Leaving pipeline mode failed");
+            }
+            Pool::instance().release(m_connectionInfo, std::move(conn));
+            return results;
+        }
+
+        static void readSync(PGconn *pg)
+        {
+            auto *sync = PQgetResult(pg);
+            const auto status = PQresultStatus(sync);
+            PQclear(sync);
+            if (status != PGRES_PIPELINE_SYNC)
+            {
+                throw std::runtime_error(std::string("Pipeline out of sync: ") + PQerrorMessage(pg));
+            }
+        }
+
+    private:
+        std::string m_connectionInfo;
+        Mode m_mode;
+        std::vector<Statement> m_statements;
+    };
+}//namespace Utils
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <drogon/HttpRequest.h>
+
+namespace Utils
+{
+    /**
+     * Per-request monotonic arena. Handler temporaries (parsed bodies, scratch
+     * strings) are bump-allocated from an inline buffer and released all at
+     * once when the request object is destroyed, which drogon does after the
+     * response has been sent. Allocations beyond the inline buffer fall back to
+     * the global heap in growing chunks. SQL parameters are not covered:
+     * execSqlCoro copies each one into a heap std::string of its own.
+     */
+    class RequestArena
+    {
+    public:
+        static constexpr size_t inlineSize = 8 * 1024;
+
+        RequestArena()
+            : m_resource(m_buffer.data(), m_buffer.size(), std::pmr::new_delete_resource())
+        {
+        }
+
+        RequestArena(const RequestArena&) = delete;
+        RequestArena& operator=(const RequestArena&) = delete;
+
+        std::pmr::memory_resource *resource() { return &m_resource; }
+
+        template<typename T = std::byte>
+        std::pmr::polymorphic_allocator<T> allocator() { return std::pmr::polymorphic_allocator<T>(&m_resource); }
+
+        // Returns the arena bound to `req`, creating it on first use.
+        static RequestArena &of(const drogon::HttpRequestPtr &req)
+        {
+            const auto &attributes = req->getAttributes();
+            if (!attributes->find(attributeKey))
+            {
+                attributes->insert(attributeKey, std::make_shared<RequestArena>());
+            }
+            return *attributes->get<std::shared_ptr<RequestArena>>(attributeKey);
+        }
+
+    private:
+        static constexpr const char *attributeKey = "requestArena";
+
+        alignas(std::max_align_t) std::array<std::byte, inlineSize> m_buffer;
+        std::pmr::monotonic_buffer_resource m_resource;
+    };
+}//namespace Utils
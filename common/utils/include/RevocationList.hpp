@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <drogon/utils/coroutine.h>
+#include <spdlog/spdlog.h>
+#include "BloomFilter.hpp"
+
+namespace Utils
+{
+    /**
+     * Node-local view of revoked token ids (`jti`). Revocations are stored in the
+     * Redis sorted set `revoked-tokens` (score = token expiry) and announced on the
+     * channel of the same name; every node keeps them in memory.
+     *
+     * `isRevoked` probes a bloom filter first, so the usual not-revoked case is a
+     * few relaxed loads; only a bloom hit takes the lock and checks the exact map.
+     * Expired ids are dropped periodically by rebuilding the inactive filter bank
+     * and switching to it.
+     */
+    class RevocationList
+    {
+    public:
+        static constexpr std::string_view channel = "revoked-tokens";
+
+        static RevocationList &instance()
+        {
+            static RevocationList list;
+            return list;
+        }
+
+        bool isRevoked(std::string_view tokenId) const
+        {
+            if (tokenId.empty())
+            {
+                return false;
+            }
+
+            const auto &bank = m_banks[m_activeBank.load(std::memory_order_acquire)];
+            if (!bank.mayContain(tokenId))
+            {
+                return false;
+            }
+
+            std::lock_guard lock(m_mutex);
+            const auto it = m_revoked.find(std::string(tokenId));
+            return it != m_revoked.end() && it->second > nowSeconds();
+        }
+
+        void revokeLocally(std::string_view tokenId, int64_t expiresAt)
+        {
+            if (tokenId.empty() || expiresAt <= nowSeconds())
+            {
+                return;
+            }
+
+            std::lock_guard lock(m_mutex);
+            m_revoked.insert_or_assign(std::string(tokenId), expiresAt);
+            // Written to both banks so a rebuild in progress cannot lose it
+            m_banks[0].add(tokenId);
+            m_banks[1].add(tokenId);
+        }
+
+        // Stores the revocation in Redis and tells the other nodes about it.
+        // Completes once both commands have been acknowledged.
+        drogon::Task<> revoke(std::string tokenId, int64_t expiresAt)
+        {
+            revokeLocally(tokenId, expiresAt);
+
+            const auto redis = drogon::app().getRedisClient();
+            co_await redis->execCommandCoro("ZADD %s %lld %s", channel.data(), static_cast<long long>(expiresAt), tokenId.c_str());
+            co_await redis->execCommandCoro("PUBLISH %s %s:%lld", channel.data(), tokenId.c_str(), static_cast<long long>(expiresAt));
+        }
+
+        // Loads the current set from Redis, subscribes to updates and schedules purging.
+        // Must be called once the Redis client exists, e.g. from a beginning advice.
+        void start(std::chrono::seconds purgeInterval = std::chrono::seconds{60})
+        {
+            const auto redis = drogon::app().getRedisClient();
+
+            m_subscriber = redis->newSubscriber();
+            m_subscriber->subscribe(std::string(channel), [this](const std::string &, const std::string &message)
+            {
+                const auto separator = message.rfind(':');
+                int64_t expiresAt = 0;
+                if (separator == std::string::npos ||
+                    std::from_chars(message.data() + separator + 1, message.data() + message.size(), expiresAt).ec != std::errc{})
+                {
+                    spdlog::warn("Malformed revocation message: {}", message);
+                    return;
+                }
+                revokeLocally(std::string_view(message).substr(0, separator), expiresAt);
+            });
+
+            redis->execCommandAsync
+            (
+                [this](const drogon::nosql::RedisResult &result)
+                {
+                    const auto entries = result.asArray();
+                    for (size_t i = 0; i + 1 < entries.size(); i += 2)
+                    {
+                        revokeLocally(entries[i].asString(), std::stoll(entries[i + 1].asString()));
+                    }
+                    spdlog::info("Loaded {} revoked tokens", entries.size() / 2);
+                },
+                [](const std::exception &e)
+                {
+                    spdlog::error("Redis error loading revoked tokens: {}", e.what());
+                },
+                "ZRANGEBYSCORE %s %lld +inf WITHSCORES", channel.data(), static_cast<long long>(nowSeconds())
+            );
+
+            drogon::app().getLoop()->runEvery(static_cast<double>(purgeInterval.count()), [this]
+            {
+                purgeExpired();
+                drogon::app().getRedisClient()->execCommandAsync
+                (
+                    [](const drogon::nosql::RedisResult &) {},
+                    [](const std::exception &e) { spdlog::error("Redis error trimming revoked tokens: {}", e.what()); },
+                    "ZREMRANGEBYSCORE %s -inf %lld", channel.data(), static_cast<long long>(nowSeconds())
+                );
+            });
+        }
+
+        void purgeExpired()
+        {
+            std::lock_guard lock(m_mutex);
+
+            const auto now = nowSeconds();
+            std::erase_if(m_revoked, [now](const auto &entry) { return entry.second <= now; });
+
+            const auto inactive = 1 - m_activeBank.load(std::memory_order_relaxed);
+            m_banks[inactive].clear();
+            for (const auto &[tokenId, expiresAt] : m_revoked)
+            {
+                m_banks[inactive].add(tokenId);
+            }
+            m_activeBank.store(inactive, std::memory_order_release);
+        }
+
+    private:
+        // 2^21 bits per bank keeps false positives around 1e-4 at 100k live revocations
+        RevocationList()
+            : m_banks{BloomFilter{1 << 21, 7}, BloomFilter{1 << 21, 7}}
+        {
+        }
+
+        static int64_t nowSeconds()
+        {
+            using namespace std::chrono;
+            return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+        }
+
+    private:
+        std::array<BloomFilter, 2> m_banks;
+        std::atomic<size_t> m_activeBank{0};
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, int64_t> m_revoked;
+
+        drogon::nosql::RedisSubscriberPtr m_subscriber;
+    };
+}//namespace Utils
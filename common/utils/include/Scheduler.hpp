@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <drogon/utils/Utilities.h>
+#include <spdlog/spdlog.h>
+#include <trantor/net/EventLoopThread.h>
+
+namespace Utils
+{
+    /**
+     * Runs periodic background jobs on a dedicated event loop, off the request
+     * threads. Every run is rescheduled with a random jitter, so nodes started
+     * together do not fire together. Jobs marked `leaderOnly` run only on the
+     * node that holds the Redis lock `scheduler:<service>:leader`. The lock is
+     * taken with SET NX PX and extended while the node is alive, so a crashed
+     * leader is replaced after one lock TTL.
+     */
+    class Scheduler
+    {
+    public:
+        // Jobs are asynchronous and must call `done` exactly once when finished;
+        // a job is never started again while its previous run is in flight.
+        using Done = std::function<void()>;
+        using Task = std::function<void(Done)>;
+
+        struct Job
+        {
+            std::string name;
+            std::chrono::seconds interval;
+            Task task;
+            bool leaderOnly = true;
+            bool runOnStart = false;
+            double jitter = 0.1;
+        };
+
+        explicit Scheduler(std::string service, std::chrono::seconds leaseTtl = std::chrono::seconds{30})
+            : m_lockKey("scheduler:" + service + ":leader")
+            , m_nodeId(drogon::utils::getUuid())
+            , m_leaseTtl(leaseTtl)
+            , m_thread(service + "-scheduler")
+            , m_random(std::random_device{}())
+        {
+        }
+
+        void addJob(Job job)
+        {
+            m_jobs.push_back(std::make_shared<JobState>(std::move(job)));
+        }
+
+        bool isLeader() const { return m_isLeader.load(std::memory_order_acquire); }
+
+        // Starts the loop, the leader election and all jobs. Call once the Redis
+        // client exists, e.g. from a beginning advice.
+        void start()
+        {
+            m_thread.run();
+            m_thread.getLoop()->queueInLoop([this]
+            {
+                refreshLease();
+                m_thread.getLoop()->runEvery(std::chrono::duration<double>(m_leaseTtl).count() / 3, [this] { refreshLease(); });
+
+                for (const auto &job : m_jobs)
+                {
+                    if (job->job.runOnStart)
+                    {
+                        run(job);
+                    }
+                    else
+                    {
+                        scheduleNext(job);
+                    }
+                }
+            });
+        }
+
+    private:
+        struct JobState
+        {
+            explicit JobState(Job job) : job(std::move(job)) {}
+
+            Job job;
+            bool running = false;
+        };
+
+        void scheduleNext(const std::shared_ptr<JobState> &state)
+        {
+            const auto interval = std::chrono::duration<double>(state->job.interval).count();
+            std::uniform_real_distribution<double> jitter(-state->job.jitter, state->job.jitter);
+
+            m_thread.getLoop()->runAfter(interval * (1.0 + jitter(m_random)), [this, state] { run(state); });
+        }
+
+        void run(const std::shared_ptr<JobState> &state)
+        {
+            if (state->running || (state->job.leaderOnly && !isLeader()))
+            {
+                scheduleNext(state);
+                return;
+            }
+
+            state->running = true;
+            const auto startedAt = std::chrono::steady_clock::now();
+            auto done = [this, state, startedAt]
+            {
+                m_thread.getLoop()->runInLoop([this, state, startedAt]
+                {
+                    state->running = false;
+                    spdlog::debug("Scheduler job '{}' finished in {} ms", state->job.name,
+                                  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startedAt).count());
+                });
+            };
+
+            try
+            {
+                state->job.task(std::move(done));
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::error("Scheduler job '{}' failed: {}", state->job.name, e.what());
+                state->running = false;
+            }
+
+            scheduleNext(state);
+        }
+
+        void refreshLease()
+        {
+            const auto redis = drogon::app().getRedisClient();
+            const auto ttlMs = static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(m_leaseTtl).count());
+            const auto onError = [this](const std::exception &e)
+            {
+                spdlog::error("Scheduler leader election error: {}", e.what());
+                setLeader(false);
+            };
+
+            if (isLeader())
+            {
+                // Extend the lease only if it is still ours
+                redis->execCommandAsync
+                (
+                    [this](const drogon::nosql::RedisResult &result) { setLeader(result.asInteger() == 1); },
+                    onError,
+                    "EVAL %s 1 %s %s %lld",
+                    "if redis.call('get', KEYS[1]) == ARGV[1] then return redis.call('pexpire', KEYS[1], ARGV[2]) else return 0 end",
+                    m_lockKey.c_str(), m_nodeId.c_str(), ttlMs
+                );
+                return;
+            }
+
+            redis->execCommandAsync
+            (
+                [this](const drogon::nosql::RedisResult &result) { setLeader(!result.isNil()); },
+                onError,
+                "SET %s %s NX PX %lld", m_lockKey.c_str(), m_nodeId.c_str(), ttlMs
+            );
+        }
+
+        void setLeader(bool isLeader)
+        {
+            if (m_isLeader.exchange(isLeader, std::memory_order_acq_rel) != isLeader)
+            {
+                spdlog::info("Scheduler {} leadership for {}", isLeader ? "acquired" : "lost", m_lockKey);
+            }
+        }
+
+    private:
+        std::string m_lockKey;
+        std::string m_nodeId;
+        std::chrono::seconds m_leaseTtl;
+        std::atomic<bool> m_isLeader{false};
+
+        trantor::EventLoopThread m_thread;
+        std::mt19937 m_random;
+        std::vector<std::shared_ptr<JobState>> m_jobs;
+    };
+}//namespace Utils
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <drogon/utils/coroutine.h>
+#include <trantor/net/EventLoop.h>
+
+namespace Utils
+{
+    /**
+     * Coalesces concurrent identical fetches. The first caller for a key runs
+     * `fetch`; callers arriving while it is in flight wait for it and receive
+     * the same value (or exception), each resumed on its own event loop. Once
+     * the fetch completes the key is forgotten, so this never serves anything
+     * older than a fetch that was already running: it is not a cache.
+     *
+     * `Value` is copied to every waiter; make it a shared_ptr to something
+     * immutable when it is large.
+     */
+    template<typename Value>
+    class SingleFlight
+    {
+    public:
+        drogon::Task<Value> run(std::string key, std::function<drogon::Task<Value>()> fetch)
+        {
+            std::shared_ptr<Flight> flight;
+            bool leader = false;
+            {
+                std::lock_guard lock(m_mutex);
+                auto &slot = m_flights[key];
+                if (!slot)
+                {
+                    slot = std::make_shared<Flight>();
+                    leader = true;
+                }
+                flight = slot;
+            }
+
+            if (!leader)
+            {
+                Join join{this, flight};
+                co_await join;
+                if (flight->error)
+                {
+                    std::rethrow_exception(flight->error);
+                }
+                co_return *flight->value;
+            }
+
+            try
+            {
+                flight->value.emplace(co_await fetch());
+            }
+            catch (...)
+            {
+                flight->error = std::current_exception();
+            }
+            land(key, *flight);
+
+            if (flight->error)
+            {
+                std::rethrow_exception(flight->error);
+            }
+            co_return *flight->value;
+        }
+
+    private:
+        struct Waiter
+        {
+            std::coroutine_handle<> handle;
+            trantor::EventLoop *loop;
+        };
+
+        struct Flight
+        {
+            bool done = false;
+            std::optional<Value> value;
+            std::exception_ptr error;
+            std::vector<Waiter> waiters;
+        };
+
+        struct Join
+        {
+            SingleFlight *owner;
+            std::shared_ptr<Flight> flight;
+
+            bool await_ready() const noexcept { return false; }
+
+            // Resumes at once when the flight landed between lookup and suspension
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                std::lock_guard lock(owner->m_mutex);
+                if (flight->done)
+                {
+                    return false;
+                }
+                flight->waiters.push_back({handle, trantor::EventLoop::getEventLoopOfCurrentThread()});
+                return true;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        void land(const std::string &key, Flight &flight)
+        {
+            std::vector<Waiter> waiters;
+            {
+                std::lock_guard lock(m_mutex);
+                flight.done = true;
+                waiters.swap(flight.waiters);
+                m_flights.erase(key);
+            }
+            for (const auto &waiter : waiters)
+            {
+                if (waiter.loop)
+                {
+                    waiter.loop->queueInLoop([handle = waiter.handle] { handle.resume(); });
+                }
+                else
+                {
+                    waiter.handle.resume();
+                }
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> m_flights;
+    };
+}//namespace Utils
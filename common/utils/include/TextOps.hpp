@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <json/json.h>
+
+/**
+ * Edits sent as operations over a text instead of the whole new text: retain
+ * the next n characters, insert a string, delete the next n characters. Counts
+ * are Unicode code points. Text after the last operation is kept as it is, so
+ * an edit near the start of a large note is a few bytes on the wire.
+ *
+ * JSON form: [{"retain": 5}, {"insert": "abc"}, {"delete": 2}]
+ */
+namespace Utils::TextOps
+{
+    struct Op
+    {
+        enum class Kind
+        {
+            Retain,
+            Insert,
+            Delete,
+        };
+
+        Kind kind;
+        size_t count = 0;
+        std::string text;
+    };
+
+    // nullopt unless `json` is a list of well-formed operations with positive counts.
+    inline std::optional<std::vector<Op>> parse(const Json::Value &json)
+    {
+        if (!json.isArray())
+        {
+            return std::nullopt;
+        }
+
+        std::vector<Op> ops;
+        ops.reserve(json.size());
+        for (const auto &entry : json)
+        {
+            if (!entry.isObject() || entry.size() != 1)
+            {
+                return std::nullopt;
+            }
+            if (entry["insert"].isString())
+            {
+                ops.push_back({Op::Kind::Insert, 0, entry["insert"].asString()});
+                continue;
+            }
+
+            const bool retain = entry.isMember("retain");
+            const auto &count = retain ? entry["retain"] : entry["delete"];
+            if (!count.isUInt64() || count.asUInt64() == 0)
+            {
+                return std::nullopt;
+            }
+            ops.push_back({retain ? Op::Kind::Retain : Op::Kind::Delete, static_cast<size_t>(count.asUInt64()), {}});
+        }
+        return ops;
+    }
+
+    namespace Detail
+    {
+        // Byte offset `count` code points after `pos`; throws past the end of `text`.
+        inline size_t advance(std::string_view text, size_t pos, size_t count)
+        {
+            for (; count > 0; --count)
+            {
+                if (pos >= text.size())
+                {
+                    throw std::invalid_argument("Operations run past the end of the text");
+                }
+                ++pos;
+                while (pos < text.size() && (static_cast<unsigned char>(text[pos]) & 0xC0) == 0x80)
+                {
+                    ++pos;
+                }
+            }
+            return pos;
+        }
+    }//namespace Detail
+
+    // Applies `ops` to `base` in one pass. Throws std::invalid_argument when they
+    // retain or delete more than `base` holds.
+    inline std::string apply(std::string_view base, const std::vector<Op> &ops)
+    {
+        size_t inserted = 0;
+        for (const auto &op : ops)
+        {
+            inserted += op.text.size();
+        }
+
+        std::string out;
+        out.reserve(base.size() + inserted);
+
+        size_t pos = 0;
+        for (const auto &op : ops)
+        {
+            switch (op.kind)
+            {
+            case Op::Kind::Retain:
+            {
+                const auto end = Detail::advance(base, pos, op.count);
+                out.append(base.substr(pos, end - pos));
+                pos = end;
+                break;
+            }
+            case Op::Kind::Insert:
+                out.append(op.text);
+                break;
+            case Op::Kind::Delete:
+                pos = Detail::advance(base, pos, op.count);
+                break;
+            }
+        }
+        out.append(base.substr(pos));
+        return out;
+    }
+}//namespace Utils::TextOps
@@ -1,11 +1,15 @@
 #pragma once
 #include <argon2.h>
+#include <openssl/evp.h>
 #include <vector>
 #include <random>
 #include <regex>
+#include <string_view>
 #include <jwt-cpp/jwt.h>
 #include <jwt-cpp/traits/kazuho-picojson/traits.h>
 #include <config.hpp>
+#include <drogon/utils/Utilities.h>
+#include "JwtKeys.hpp"
 
 namespace Utils
 {
@@ -62,6 +66,28 @@ namespace Utils
         }   
     }
 
+    namespace Hash
+    {
+        inline std::string sha256Hex(std::string_view data)
+        {
+            unsigned char digest[EVP_MAX_MD_SIZE];
+            unsigned int length = 0;
+            if (EVP_Digest(data.data(), data.size(), digest, &length, EVP_sha256(), nullptr) != 1)
+            {
+                throw std::runtime_error("Error computing SHA-256");
+            }
+
+            static constexpr char hex[] = "0123456789abcdef";
+            std::string result(length * 2, '\0');
+            for (unsigned int i = 0; i < length; ++i)
+            {
+                result[2 * i] = hex[digest[i] >> 4];
+                result[2 * i + 1] = hex[digest[i] & 0x0F];
+            }
+            return result;
+        }
+    }
+
     namespace Email
     {
         inline bool isValidEmail(const std::string& email)
@@ -92,7 +118,7 @@ namespace Utils
             }
         }
 
-        inline bool fromString(const std::string& strType, TokenType& enumType)
+        inline bool fromString(std::string_view strType, TokenType& enumType)
         {
             if(toString(TokenType::ACCESS) == strType) return enumType = TokenType::ACCESS, true;
             if(toString(TokenType::REFRESH) == strType) return enumType = TokenType::REFRESH, true;
@@ -100,51 +126,36 @@ namespace Utils
             return false;
         }
 
-        inline std::string generateJwt(const std::string &userId, TokenType type, const std::chrono::hours duration = std::chrono::hours{1})
+        inline std::string generateJwt(const std::string &userId,
+                                       TokenType type,
+                                       const std::chrono::hours duration = std::chrono::hours{1},
+                                       const std::string &sessionId = {})
         {
-                auto token = jwt::create<jwt::traits::kazuho_picojson>()
+            auto builder = jwt::create<jwt::traits::kazuho_picojson>()
                 .set_type("JWT")
                 .set_issuer("auth-service")
                 .set_payload_claim("type", jwt::traits::kazuho_picojson::value_type{toString(type)})
                 .set_subject(userId)
+                .set_id(drogon::utils::getUuid())
                 .set_issued_at(std::chrono::system_clock::now())
-                .set_expires_at(std::chrono::system_clock::now() + duration)
-                .sign(jwt::algorithm::hs256{Config::jwtSecretKey.data()});
-
-            return token;
-        }
-
-        struct DecodedToken
-        {
-            TokenType type = TokenType::ACCESS;
-            jwt::decoded_jwt<jwt::traits::kazuho_picojson> decoded;
-        };
-
-        inline DecodedToken verifyJwt(const std::string &token)
-        {
-            auto decoded = jwt::decode<jwt::traits::kazuho_picojson>(token);
+                .set_expires_at(std::chrono::system_clock::now() + duration);
 
-            auto verifier = jwt::verify<jwt::traits::kazuho_picojson>()
-                .allow_algorithm(jwt::algorithm::hs256{Config::jwtSecretKey.data()})
-                .with_issuer("auth-service");
-
-            verifier.verify(decoded);
-
-            if (!decoded.has_payload_claim("sub"))
+            if (!sessionId.empty())
             {
-                throw std::runtime_error("User id is not present in token");
+                builder.set_payload_claim("sid", jwt::traits::kazuho_picojson::value_type{sessionId});
             }
 
-            TokenType tokenType;
-            if (!decoded.has_payload_claim("type") || 
-                !fromString(decoded.get_payload_claim("type").as_string(), tokenType))
+            const auto keys = KeyStore::instance().snapshot();
+            if (const auto *key = keys ? keys->signingKey() : nullptr)
             {
-                throw std::runtime_error("Error getting token type");
+                return builder.set_key_id(key->kid()).sign(KeySigner{*key});
             }
 
-            DecodedToken result{.type = tokenType, .decoded = std::move(decoded)};
-
-            return result;
+            if (!Config::jwtAllowHs256)
+            {
+                throw std::runtime_error("No JWT signing key is loaded");
+            }
+            return builder.sign(jwt::algorithm::hs256{Config::jwtSecretKey.data()});
         }
     }//namespace Jwt
 }//namespace Utils
\ No newline at end of file
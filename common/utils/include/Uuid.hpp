@@ -0,0 +1,172 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace Utils
+{
+    /**
+     * 128-bit id in RFC 9562 byte order. Parsing and formatting go through
+     * lookup tables a byte at a time, with no streams or locale involved.
+     */
+    class Uuid
+    {
+    public:
+        static constexpr size_t textSize = 36;
+
+        constexpr Uuid() = default;
+        explicit constexpr Uuid(const std::array<uint8_t, 16> &bytes)
+            : m_bytes(bytes)
+        {
+        }
+
+        // Accepts the canonical 8-4-4-4-12 form and 32 bare hex digits, in either case.
+        static constexpr std::optional<Uuid> parse(std::string_view text)
+        {
+            const bool dashed = text.size() == textSize;
+            if (!dashed && text.size() != 32)
+            {
+                return std::nullopt;
+            }
+            if (dashed && (text[8] != '-' || text[13] != '-' || text[18] != '-' || text[23] != '-'))
+            {
+                return std::nullopt;
+            }
+
+            Uuid uuid;
+            size_t pos = 0;
+            for (size_t i = 0; i < uuid.m_bytes.size(); ++i)
+            {
+                if (dashed && (i == 4 || i == 6 || i == 8 || i == 10))
+                {
+                    ++pos;
+                }
+                const auto high = hexValues[static_cast<uint8_t>(text[pos])];
+                const auto low = hexValues[static_cast<uint8_t>(text[pos + 1])];
+                if ((high | low) < 0)
+                {
+                    return std::nullopt;
+                }
+                uuid.m_bytes[i] = static_cast<uint8_t>(high << 4 | low);
+                pos += 2;
+            }
+            return uuid;
+        }
+
+        /**
+         * Version 7: a 48-bit Unix millisecond timestamp, a 12-bit counter and
+         * 62 random bits. Ids sort by creation time, so inserts land on the right
+         * edge of a B-tree instead of random pages. Within a thread the ids are
+         * strictly increasing: the counter starts at a random value below 2048
+         * every millisecond and, should it run out, borrows the next millisecond.
+         * The random bits come from a per-thread generator; these ids are unique,
+         * not secret.
+         */
+        static Uuid v7()
+        {
+            struct State
+            {
+                std::mt19937_64 random{std::random_device{}()};
+                uint64_t lastMillis = 0;
+                uint32_t counter = 0;
+            };
+            thread_local State state;
+
+            using namespace std::chrono;
+            const auto now = static_cast<uint64_t>(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
+            if (now > state.lastMillis)
+            {
+                state.lastMillis = now;
+                state.counter = static_cast<uint32_t>(state.random() & 0x7ff);
+            }
+            else if (++state.counter > 0xfff)
+            {
+                ++state.lastMillis;
+                state.counter = 0;
+            }
+
+            const auto random = state.random();
+            const auto millis = state.lastMillis;
+
+            Uuid uuid;
+            for (size_t i = 0; i < 6; ++i)
+            {
+                uuid.m_bytes[i] = static_cast<uint8_t>(millis >> (40 - 8 * i));
+            }
+            uuid.m_bytes[6] = static_cast<uint8_t>(0x70 | (state.counter >> 8));
+            uuid.m_bytes[7] = static_cast<uint8_t>(state.counter);
+            uuid.m_bytes[8] = static_cast<uint8_t>(0x80 | ((random >> 56) & 0x3f));
+            for (size_t i = 9; i < 16; ++i)
+            {
+                uuid.m_bytes[i] = static_cast<uint8_t>(random >> (8 * (15 - i)));
+            }
+            return uuid;
+        }
+
+        // Writes the canonical lowercase form, exactly textSize characters.
+        constexpr void format(char *out) const
+        {
+            for (size_t i = 0; i < m_bytes.size(); ++i)
+            {
+                if (i == 4 || i == 6 || i == 8 || i == 10)
+                {
+                    *out++ = '-';
+                }
+                const auto *pair = &hexPairs[m_bytes[i] * 2];
+                *out++ = pair[0];
+                *out++ = pair[1];
+            }
+        }
+
+        std::string toString() const
+        {
+            std::string text(textSize, '\0');
+            format(text.data());
+            return text;
+        }
+
+        constexpr const std::array<uint8_t, 16> &bytes() const { return m_bytes; }
+        constexpr uint8_t version() const { return m_bytes[6] >> 4; }
+
+        constexpr auto operator<=>(const Uuid &) const = default;
+
+    private:
+        static constexpr auto hexValues = []
+        {
+            std::array<int8_t, 256> values{};
+            values.fill(-1);
+            for (int i = 0; i < 10; ++i)
+            {
+                values['0' + i] = static_cast<int8_t>(i);
+            }
+            for (int i = 0; i < 6; ++i)
+            {
+                values['a' + i] = static_cast<int8_t>(10 + i);
+                values['A' + i] = static_cast<int8_t>(10 + i);
+            }
+            return values;
+        }();
+
+        // Both digits of every byte value, so formatting is one lookup per byte
+        static constexpr auto hexPairs = []
+        {
+            constexpr std::string_view digits = "0123456789abcdef";
+            std::array<char, 512> pairs{};
+            for (size_t i = 0; i < 256; ++i)
+            {
+                pairs[i * 2] = digits[i >> 4];
+                pairs[i * 2 + 1] = digits[i & 0xf];
+            }
+            return pairs;
+        }();
+
+    private:
+        std::array<uint8_t, 16> m_bytes{};
+    };
+}//namespace Utils
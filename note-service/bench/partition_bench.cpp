@@ -0,0 +1,183 @@
+// note-partition-bench: what hash-partitioning notes by owner changes for the
+// database. Builds a scratch schema with the notes table laid out flat and
+// split 32 ways by HASH (user_id), as migration 008 does, and compares point
+// lookups by (user_id, id), partition pruning, index sizes and VACUUM after
+// an update wave. The schema is dropped at the end.
+//
+// Usage: note-partition-bench <connection string> [seconds per case] [rows]
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <pqxx/pqxx>
+#include "Bench.hpp"
+
+namespace
+{
+    constexpr std::string_view schema = "note_partition_bench";
+    constexpr int partitions = 32;
+    constexpr int notesPerUser = 100;
+    // Keys the lookups pick from
+    constexpr int sampleSize = 10'000;
+
+    using Key = std::pair<std::string, std::string>;
+
+    void exec(pqxx::connection& conn, const std::string& sql)
+    {
+        pqxx::nontransaction tx{conn};
+        tx.exec(sql);
+    }
+
+    void createTables(pqxx::connection& conn, long rows)
+    {
+        exec(conn, std::format("DROP SCHEMA IF EXISTS {0} CASCADE; CREATE SCHEMA {0}", schema));
+        exec(conn, std::format
+        (
+            "CREATE TABLE {0}.flat (id UUID NOT NULL, user_id UUID NOT NULL, title VARCHAR(255) NOT NULL, "
+            "content TEXT NOT NULL, revision BIGINT NOT NULL DEFAULT 1, PRIMARY KEY (user_id, id)); "
+            "CREATE TABLE {0}.partitioned (LIKE {0}.flat INCLUDING ALL) PARTITION BY HASH (user_id)",
+            schema
+        ));
+        for (int i = 0; i < partitions; ++i)
+        {
+            exec(conn, std::format("CREATE TABLE {0}.partitioned_p{1} PARTITION OF {0}.partitioned FOR VALUES WITH (MODULUS {2}, REMAINDER {1})",
+                                   schema, i, partitions));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        exec(conn, std::format
+        (
+            "INSERT INTO {0}.flat (id, user_id, title, content) "
+            "SELECT gen_random_uuid(), u.id, 'Note ' || n, repeat('x', 200) "
+            "FROM (SELECT gen_random_uuid() AS id FROM generate_series(1, {1})) u, generate_series(1, {2}) n; "
+            "INSERT INTO {0}.partitioned SELECT * FROM {0}.flat; "
+            "ANALYZE {0}.flat; ANALYZE {0}.partitioned",
+            schema, std::max(1L, rows / notesPerUser), notesPerUser
+        ));
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("Loaded {} notes into each table in {:.1f} s\n", std::max(1L, rows / notesPerUser) * notesPerUser, elapsed.count());
+    }
+
+    std::vector<Key> sampleKeys(pqxx::connection& conn)
+    {
+        pqxx::nontransaction tx{conn};
+        std::vector<Key> keys;
+        for (auto [userId, id] : tx.query<std::string, std::string>(
+                 std::format("SELECT user_id::text, id::text FROM {}.flat ORDER BY random() LIMIT {}", schema, sampleSize)))
+        {
+            keys.emplace_back(std::move(userId), std::move(id));
+        }
+        return keys;
+    }
+
+    void printPlan(pqxx::connection& conn, std::string_view table, const Key& key)
+    {
+        pqxx::nontransaction tx{conn};
+        std::cout << std::format("Plan of a lookup in {}:\n", table);
+        for (auto [line] : tx.query<std::string>(std::format("EXPLAIN (COSTS OFF) SELECT title FROM {}.{} WHERE user_id = '{}' AND id = '{}'",
+                                                             schema, table, key.first, key.second)))
+        {
+            std::cout << "    " << line << '\n';
+        }
+    }
+
+    void printIndexSizes(pqxx::connection& conn)
+    {
+        pqxx::nontransaction tx{conn};
+        const auto [flat, total, largest] = tx.query1<std::string, std::string, std::string>(std::format
+        (
+            "SELECT pg_size_pretty(pg_relation_size('{0}.flat_pkey')), "
+            "pg_size_pretty(sum(pg_relation_size(i.indexrelid))), pg_size_pretty(max(pg_relation_size(i.indexrelid))) "
+            "FROM pg_inherits h JOIN pg_index i ON i.indrelid = h.inhrelid WHERE h.inhparent = '{0}.partitioned'::regclass",
+            schema
+        ));
+        std::cout << std::format("Primary key size: flat {}, partitioned {} in total, {} in the largest partition\n", flat, total, largest);
+    }
+
+    void runLookups(const std::string& connection, std::string_view table, std::shared_ptr<const std::vector<Key>> keys, std::chrono::milliseconds duration)
+    {
+        const auto sql = std::format("SELECT title FROM {}.{} WHERE user_id = $1 AND id = $2", schema, table);
+        const auto makeBody = [&connection, &sql, keys]
+        {
+            auto conn = std::make_shared<pqxx::connection>(connection);
+            conn->prepare("lookup", sql);
+            return [conn, keys, next = std::minstd_rand{std::random_device{}()}]() mutable
+            {
+                const auto& [userId, id] = (*keys)[next() % keys->size()];
+                pqxx::nontransaction tx{*conn};
+                if (tx.exec_prepared("lookup", userId, id).size() != 1)
+                {
+                    std::abort();
+                }
+            };
+        };
+        const auto name = std::format("Point lookup, {}", table);
+        Bench::print(name, Bench::run(makeBody, duration, 1));
+        Bench::print(name, Bench::run(makeBody, duration, std::thread::hardware_concurrency()));
+    }
+
+    double timeVacuum(pqxx::connection& conn, std::string_view table)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        exec(conn, std::format("VACUUM {}.{}", schema, table));
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    // One edit on every tenth note leaves the same dead rows in both layouts
+    void runVacuum(pqxx::connection& conn)
+    {
+        exec(conn, std::format
+        (
+            "UPDATE {0}.flat SET revision = revision + 1 WHERE hashtext(id::text) % 10 = 0; "
+            "UPDATE {0}.partitioned SET revision = revision + 1 WHERE hashtext(id::text) % 10 = 0",
+            schema
+        ));
+        std::cout << std::format("VACUUM after updating 10% of notes: flat {:.3f} s, one partition {:.3f} s, all partitions {:.3f} s\n",
+                                 timeVacuum(conn, "flat"), timeVacuum(conn, "partitioned_p0"), timeVacuum(conn, "partitioned"));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: note-partition-bench <connection string> [seconds per case] [rows]\n";
+        return 1;
+    }
+    const std::string connection = argv[1];
+    const auto duration = Bench::duration(argc - 1, argv + 1);
+    const long rows = argc > 3 ? std::atol(argv[3]) : 1'000'000;
+
+    pqxx::connection conn{connection};
+    try
+    {
+        createTables(conn, rows);
+        const auto keys = std::make_shared<const std::vector<Key>>(sampleKeys(conn));
+
+        printPlan(conn, "flat", keys->front());
+        printPlan(conn, "partitioned", keys->front());
+        printIndexSizes(conn);
+
+        runLookups(connection, "flat", keys, duration);
+        runLookups(connection, "partitioned", keys, duration);
+
+        runVacuum(conn);
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Benchmark failed: " << ex.what() << '\n';
+        exec(conn, std::format("DROP SCHEMA IF EXISTS {} CASCADE", schema));
+        return 1;
+    }
+
+    exec(conn, std::format("DROP SCHEMA IF EXISTS {} CASCADE", schema));
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <BaseController.hpp>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Files attached to notes. Metadata lives in note_attachments next to the note;
+// the bytes live in BlobStore, so identical files are stored once. Downloads
+// are sent from disk with sendfile and honour single byte ranges.
+class AttachmentController : public BaseController<AttachmentController>
+{
+public:
+    METHOD_LIST_BEGIN
+        ADD_METHOD_TO(AttachmentController::listAttachments, "/notes/{id}/attachments", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(AttachmentController::uploadAttachment, "/notes/{id}/attachments", drogon::Post, "JwtAuthFilter");
+        ADD_METHOD_TO(AttachmentController::downloadAttachment, "/notes/{id}/attachments/{attachmentId}", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(AttachmentController::deleteAttachment, "/notes/{id}/attachments/{attachmentId}", drogon::Delete, "JwtAuthFilter");
+    METHOD_LIST_END
+
+    drogon::Task<drogon::HttpResponsePtr> listAttachments(drogon::HttpRequestPtr req, std::string noteId);
+    drogon::Task<drogon::HttpResponsePtr> uploadAttachment(drogon::HttpRequestPtr req, std::string noteId);
+    drogon::Task<drogon::HttpResponsePtr> downloadAttachment(drogon::HttpRequestPtr req, std::string noteId, std::string attachmentId);
+    drogon::Task<drogon::HttpResponsePtr> deleteAttachment(drogon::HttpRequestPtr req, std::string noteId, std::string attachmentId);
+
+private:
+    // Offset and length of a single `bytes=` range over `size` bytes. Lists of
+    // ranges and malformed headers select the whole file; a range that starts
+    // past the end has length 0.
+    static std::pair<size_t, size_t> byteRange(std::string_view header, size_t size);
+
+    // Client file name reduced to something safe to echo in Content-Disposition
+    static std::string safeName(std::string_view name);
+
+private:
+    static constexpr size_t maxAttachmentSize = 256 * 1024 * 1024;
+    static constexpr size_t maxNameLength = 255;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <drogon/utils/coroutine.h>
+
+// Content-addressed storage for attachment bytes on local disk. A blob is kept
+// once under the hex SHA-256 of its content, at <root>/<first two digits>/<hash>,
+// however many attachments point at it. Files are written under a temporary
+// name, synced and renamed into place, so an existing path always holds the
+// complete content. Every node must see the same root, e.g. a shared volume.
+//
+// Deleting an attachment leaves its blob; collectGarbage removes blobs no
+// note_attachments row on any shard references. A blob written or reused
+// within `gcGrace` is kept, so an upload whose row is not committed yet does
+// not lose its file.
+namespace BlobStore
+{
+    constexpr std::chrono::hours gcInterval{6};
+    constexpr std::chrono::hours gcGrace{1};
+
+    // Stores `data` unless an identical blob exists and returns its hash. Blocks
+    // on hashing and disk I/O, so it must run off the event loops.
+    std::string put(std::string_view data);
+
+    std::string pathOf(std::string_view hash);
+
+    // Removes unreferenced blobs and temporary files older than gcGrace, then
+    // calls `done`. Removes nothing when a shard could not be asked.
+    drogon::AsyncTask collectGarbage(std::function<void()> done);
+}
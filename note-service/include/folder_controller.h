@@ -0,0 +1,22 @@
+#pragma once
+
+#include <BaseController.hpp>
+#include <string>
+
+// Per-user folder tree. Folders are private to their owner; shared notes are
+// filed separately by each user through note_acl.folder_id.
+class FolderController : public BaseController<FolderController>
+{
+public:
+    METHOD_LIST_BEGIN
+        ADD_METHOD_TO(FolderController::listFolders, "/folders", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(FolderController::createFolder, "/folders", drogon::Post, "JwtAuthFilter");
+        ADD_METHOD_TO(FolderController::deleteFolder, "/folders/{id}", drogon::Delete, "JwtAuthFilter");
+        ADD_METHOD_TO(FolderController::moveNote, "/notes/{id}/folder", drogon::Put, "JwtAuthFilter");
+    METHOD_LIST_END
+
+    drogon::Task<drogon::HttpResponsePtr> listFolders(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> createFolder(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> deleteFolder(drogon::HttpRequestPtr req, std::string folderId);
+    drogon::Task<drogon::HttpResponsePtr> moveNote(drogon::HttpRequestPtr req, std::string noteId);
+};
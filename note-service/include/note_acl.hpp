@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <ExpiringCache.hpp>
+
+// Note sharing. Every (user, note) pair with access has a row in note_acl; the
+// note's creator is its owner. Decisions are cached per (note, user) on every
+// node and invalidated through the Redis channel `note-acl`.
+namespace NoteAcl
+{
+    // Ordered: a role allows everything the lower ones do
+    enum class Role
+    {
+        None,
+        Viewer,
+        Editor,
+        Owner,
+    };
+
+    constexpr std::string_view channel = "note-acl";
+    constexpr std::chrono::minutes cacheTtl{1};
+
+    std::string_view toString(Role role);
+    // Maps a note_role value (or SQL NULL read as empty) to a Role; nullopt for anything else.
+    std::optional<Role> fromString(std::string_view role);
+
+    Utils::ExpiringCache<std::string, Role>& cache();
+    std::string cacheKey(std::string_view noteId, std::string_view userId);
+
+    // Drops cached decisions on this node and on all others. An empty `userId`
+    // drops every user's decision for the note.
+    void invalidate(const std::string& noteId, const std::string& userId = {});
+
+    // Subscribes to invalidations from other nodes. Call once the Redis client exists.
+    void start();
+}
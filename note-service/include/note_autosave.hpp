@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <drogon/utils/coroutine.h>
+
+// Write-behind for autosave edits. PATCH /notes/{id}?autosave=1 stages the edit
+// in memory and answers 202. Edits of one note within `window` merge field by
+// field, the latest value winning, and reach the database as a single revision
+// by the last editor. An accepted edit is stored at most `window` later;
+// staged edits are flushed when the node shuts down.
+//
+// Staged edits live on the node that accepted them. Reads and direct writes of
+// the note on that node flush it first, so they see it and are not overwritten
+// by it. A direct write on another node can not see it; if that write stores a
+// revision after the edit was last staged, the newer revision wins and the
+// staged edit is dropped, as a direct write on the same node would have
+// replaced it.
+//
+// The window must stay below note-shard-migrate's grace period, so no staged
+// edit lands on a shard its user has left.
+namespace NoteAutosave
+{
+    constexpr std::chrono::seconds window{2};
+    // Beyond this many staged notes, edits are written directly
+    constexpr size_t maxPending = 10'000;
+
+    // Stages an edit the caller has checked `userId` may make. Returns false when
+    // too many edits are pending; the caller then writes it directly.
+    bool stage(const std::string& noteId, const std::string& userId, std::optional<std::string> title, std::optional<std::string> content);
+
+    // Stores the staged edit of a note now, if there is one, and returns whether
+    // there was. Reads and direct writes call this first, so a read sees the edit
+    // and a later flush can not overwrite a write.
+    drogon::Task<bool> flush(std::string noteId);
+
+    // Stores every staged edit and calls `done` once all have finished.
+    void flushAll(std::function<void()> done);
+}
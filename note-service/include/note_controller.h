@@ -1,9 +1,15 @@
 #pragma once
 
 #include <BaseController.hpp>
+#include <SingleFlight.hpp>
 #include <hiredis/hiredis.h>
 #include <librdkafka/rdkafkacpp.h>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <variant>
+#include "note_acl.hpp"
 
 class NoteController : public BaseController<NoteController>
 {
@@ -11,29 +17,100 @@ public:
     NoteController();
 public:
     METHOD_LIST_BEGIN
+        ADD_METHOD_TO(NoteController::listNotes, "/notes", drogon::Get, "JwtAuthFilter");
         ADD_METHOD_TO(NoteController::createNote, "/notes", drogon::Post, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::noteStats, "/notes/stats", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::noteChanges, "/notes/changes", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::importNotes, "/notes/import", drogon::Post, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::exportNotes, "/notes/export", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::batchNotes, "/notes/batch", drogon::Post, "JwtAuthFilter");
         ADD_METHOD_TO(NoteController::readNote, "/notes/{id}", drogon::Get, "JwtAuthFilter");
         ADD_METHOD_TO(NoteController::updateNote, "/notes/{id}", drogon::Patch, "JwtAuthFilter");
         ADD_METHOD_TO(NoteController::deleteNote, "/notes/{id}", drogon::Delete, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::shareNote, "/notes/{id}/acl/{userId}", drogon::Put, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::unshareNote, "/notes/{id}/acl/{userId}", drogon::Delete, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::listRevisions, "/notes/{id}/revisions", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::readRevision, "/notes/{id}/revisions/{revision}", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(NoteController::restoreRevision, "/notes/{id}/revisions/{revision}/restore", drogon::Post, "JwtAuthFilter");
     METHOD_LIST_END
 
-    void createNote(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback);
-    void readNote(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback, std::string&& noteId);
-    void updateNote(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback, std::string&& noteId);
-    void deleteNote(const drogon::HttpRequestPtr& req, std::function<void(const drogon::HttpResponsePtr&)>&& callback, std::string&& noteId);
+    drogon::Task<drogon::HttpResponsePtr> listNotes(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> createNote(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> noteStats(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> noteChanges(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> importNotes(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> exportNotes(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> batchNotes(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> readNote(drogon::HttpRequestPtr req, std::string noteId);
+    drogon::Task<drogon::HttpResponsePtr> updateNote(drogon::HttpRequestPtr req, std::string noteId);
+    drogon::Task<drogon::HttpResponsePtr> deleteNote(drogon::HttpRequestPtr req, std::string noteId);
+    drogon::Task<drogon::HttpResponsePtr> shareNote(drogon::HttpRequestPtr req, std::string noteId, std::string userId);
+    drogon::Task<drogon::HttpResponsePtr> unshareNote(drogon::HttpRequestPtr req, std::string noteId, std::string userId);
+    drogon::Task<drogon::HttpResponsePtr> listRevisions(drogon::HttpRequestPtr req, std::string noteId);
+    drogon::Task<drogon::HttpResponsePtr> readRevision(drogon::HttpRequestPtr req, std::string noteId, int64_t revision);
+    drogon::Task<drogon::HttpResponsePtr> restoreRevision(drogon::HttpRequestPtr req, std::string noteId, int64_t revision);
 
 private:
     int64_t currentTimestamp() const;
 
+    // Parses an optional non-negative integer query parameter.
+    static std::optional<int64_t> integerParameter(const drogon::HttpRequestPtr& req, const std::string& name, int64_t fallback);
+
+    // Answers from the ACL cache when it already shows that `userId` lacks `required`.
+    // Every note route calls it first; it rewrites `noteId` to the canonical UUID
+    // spelling the cache and the invalidations are keyed by.
+    static std::optional<drogon::HttpResponsePtr> denied(std::string& noteId, const std::string& userId, NoteAcl::Role required);
+    // Caches the role returned by a refused statement and builds the matching error.
+    static drogon::HttpResponsePtr deniedBy(const std::string& noteId, const std::string& userId, const drogon::orm::Row& row);
+
+    // A note locked for an edit: the open transaction and the NoteHistory::lock row.
+    struct Editable
+    {
+        drogon::orm::DbClientPtr tx;
+        drogon::orm::Result result;
+    };
+    // Locks the note if `userId` may edit it, otherwise returns the error response.
+    static drogon::Task<std::variant<Editable, drogon::HttpResponsePtr>> editable(std::string noteId, std::string userId);
+
+    // Applies a Utils::TextOps edit to the content if the note is still at the client's base revision.
+    drogon::Task<drogon::HttpResponsePtr> patchContent(drogon::HttpRequestPtr req, std::string noteId, Json::Value body);
+
+    // Reads a note for a reader whose role is already cached; concurrent reads of one note share a query.
+    drogon::Task<drogon::HttpResponsePtr> sharedRead(std::string noteId, std::string userId);
+
+    // Writes the user's notes to `stream` as NDJSON, exportBatchSize rows at a time.
+    static drogon::AsyncTask streamExport(drogon::ResponseStreamPtr stream, std::string userId);
+
+private:
+    static constexpr int64_t defaultPageSize = 50;
+    static constexpr int64_t maxPageSize = 200;
+    static constexpr int64_t exportBatchSize = 500;
+    static constexpr Json::ArrayIndex maxBatchOperations = 100;
+
 private:
     redisContext* m_redis;
+    struct SharedNote
+    {
+        // Serialized title, content and revision, without the closing brace
+        std::string body;
+        // Everyone with access when the note was read, by user id
+        std::unordered_map<std::string, NoteAcl::Role> roles;
+    };
+
+    // Null once the note is gone
+    Utils::SingleFlight<std::shared_ptr<const SharedNote>> m_noteReads;
     std::unique_ptr<RdKafka::Producer> m_kafkaProducer;
     const std::string m_kafkaTopic = "notes-topic";
 
     struct PostBody
     {
-        std::string title;
-        std::string content;
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        PostBody() = default;
+        explicit PostBody(allocator_type allocator) : title(allocator), content(allocator) {}
+
+        std::pmr::string title;
+        std::pmr::string content;
 
 
         static PostBody fromSqlRecord(const drogon::orm::Row& row)
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <drogon/orm/DbClient.h>
+#include <drogon/utils/coroutine.h>
+
+// Revision history of notes. Every edit bumps notes.revision and stores the new
+// content in note_revisions as a Utils::Delta against the previous revision;
+// every snapshotInterval-th revision is stored in full, so rebuilding any
+// revision applies at most snapshotInterval - 1 deltas.
+namespace NoteHistory
+{
+    constexpr int64_t snapshotInterval = 32;
+
+    struct Revision
+    {
+        int64_t revision;
+        std::string title;
+        std::string content;
+    };
+
+    // Locks the note for an edit inside `tx`. The row carries the caller's role,
+    // the note's owner_id, title, content, revision and its users as comma
+    // separated `recipients`; the result is empty without any access.
+    drogon::Task<drogon::orm::Result> lock(drogon::orm::DbClientPtr tx, std::string noteId, std::string userId);
+
+    // Saves `title` and `content` as the revision after `current` (a row returned
+    // by lock) and returns its number.
+    drogon::Task<int64_t> write(drogon::orm::DbClientPtr tx, std::string noteId, std::string authorId,
+                                const drogon::orm::Row& current, std::string title, std::string content);
+
+    // Rebuilds `revision` from the nearest snapshot at or before it.
+    drogon::Task<std::optional<Revision>> read(drogon::orm::DbClientPtr db, std::string noteId, int64_t revision);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bulk import of notes from NDJSON, one {"title": ..., "content": ...} object per
+// line. Lines are parsed one at a time from the request body, which drogon keeps
+// in a temporary file once it outgrows client_max_memory_body_size, and streamed
+// into a staging table with COPY. Each batch of batchSize records is then moved
+// into notes, note_revisions and note_acl by one statement and committed on its
+// own, so memory stays bounded by a single record and a failed batch does not
+// undo the ones before it.
+namespace NoteImport
+{
+    constexpr size_t batchSize = 10'000;
+    constexpr size_t maxReportedErrors = 100;
+    // Each running import holds a worker thread and a database connection
+    constexpr int maxConcurrentImports = 2;
+
+    struct Report
+    {
+        struct Error
+        {
+            size_t line;
+            std::string message;
+        };
+
+        size_t imported = 0;
+        size_t failed = 0;
+        // The first maxReportedErrors failures, in line order
+        std::vector<Error> errors;
+
+        void fail(size_t line, std::string message, size_t records = 1);
+    };
+
+    // Reserves one of the node's import slots; null when all are taken. The slot
+    // is released with the returned handle.
+    std::shared_ptr<void> acquireSlot();
+
+    // Imports `body` for `userId` over a connection of its own to `connectionInfo`.
+    // Blocks until done, so it must run off the event loops. Throws pqxx::failure
+    // when the connection is lost.
+    Report run(const std::string& connectionInfo, const std::string& userId, std::string_view body);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <drogon/WebSocketConnection.h>
+
+// Change notifications for connected clients. Writers publish the affected
+// users of a note; every node delivers to the sockets it holds, locally without
+// a round trip and to other nodes through the Redis channel `note-changes`.
+// Clients fetch the content itself through GET /notes/changes.
+namespace NotePush
+{
+    constexpr std::string_view channel = "note-changes";
+    // Notifications for a connection are collected this long and sent as one message
+    constexpr std::chrono::milliseconds batchDelay{100};
+    // A batch this large is sent without waiting for batchDelay
+    constexpr size_t maxBatch = 256;
+
+    void attach(const std::string& userId, const drogon::WebSocketConnectionPtr& conn);
+    void detach(const drogon::WebSocketConnectionPtr& conn);
+
+    // `recipients` is a comma separated list of user ids, as built by string_agg.
+    void publish(std::string_view noteId, std::string_view recipients, bool deleted);
+
+    // Subscribes to notifications from other nodes. Call once the Redis client exists.
+    void start();
+}
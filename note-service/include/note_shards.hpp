@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <drogon/orm/DbClient.h>
+#include <drogon/utils/coroutine.h>
+
+// Placement of users on database shards. A user's notes, folders, tags and
+// sync state live on one shard, picked by a consistent hash of the user id
+// over `shards` from the drogon custom config.
+//
+// To change the shard count, list the new layout as `target_shards` and run
+// note-shard-migrate. It moves the users whose shard differs and records each
+// move as a pin in the Redis hash `shard-pins`, so nodes follow the move at
+// once. Users who share notes move together, as one sharing group in one copy,
+// to the target shard most of the group hashes to; members that hash elsewhere
+// keep a pin to the group's shard. A pin `moving:<shard>` keeps the user on
+// <shard> with writes refused while the data is copied. Once every user has
+// moved, `shards` becomes the target layout and --clear-pins drops the pins
+// the ring now repeats.
+//
+// A grant lives on the owner's shard, next to the note, so sharing with a
+// user on another shard first co-locates the grantee: its sharing group is
+// copied to the owner's shard and pinned there for good, the way
+// note-shard-migrate moves a group. Those pins differ from the ring, so
+// --clear-pins keeps them. Both take `shard-move-lock`, one move at a time.
+//
+// Nodes load the pins before serving and follow the channel `shard-pins`.
+// A message lost while the subscriber reconnects is made up by a full resync
+// every pinsResyncInterval, so note-shard-migrate's grace period must be
+// longer than that.
+namespace NoteShards
+{
+    constexpr std::string_view pinsKey = "shard-pins";
+    constexpr std::string_view movingPrefix = "moving:";
+    constexpr std::chrono::seconds pinsResyncInterval{3};
+    // How long a move waits after changing pins, for writes in flight and for
+    // nodes that missed the message
+    constexpr std::chrono::seconds moveGrace{5};
+    constexpr std::string_view moveLockKey = "shard-move-lock";
+    constexpr std::chrono::seconds moveLockTtl{600};
+    // Releases the lock only for the token that took it: EVAL <script> 1 <key> <token>
+    constexpr std::string_view unlockScript =
+        "if redis.call('GET', KEYS[1]) == ARGV[1] then return redis.call('DEL', KEYS[1]) end return 0";
+
+    // Reads the layout from the custom config, subscribes to pin changes and
+    // loads the pins, blocking until Redis answers. Call once the Redis client
+    // exists.
+    void start();
+    // Reloads every pin from Redis and calls `done`.
+    void resync(std::function<void()> done);
+    // False until the pins have been loaded once; requests must wait for it.
+    bool ready();
+
+    std::string shardFor(const std::string& userId);
+    // True while the user's data is being copied to another shard.
+    bool isMoving(const std::string& userId);
+
+    // Moves the sharing group of `userId` to the shard of `hostId` unless they
+    // already share one. Takes at least moveGrace. False when the group could
+    // not move now: another move holds the lock, either user is moving, or the
+    // copy failed and the group was left where it was.
+    drogon::Task<bool> colocate(std::string userId, std::string hostId);
+
+    drogon::orm::DbClientPtr primary(const std::string& userId);
+    // Replica of the user's shard, unless the user wrote recently (see Utils::DbRouter).
+    drogon::orm::DbClientPtr forRead(const std::string& userId);
+
+    // Runs a background job on every shard primary, target shards included, and
+    // calls `done` after the last one finishes.
+    void forEachShard(const std::function<void(const drogon::orm::DbClientPtr&, std::function<void()>)>& job, std::function<void()> done);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+#include <drogon/WebSocketController.h>
+
+// Pushes change notifications for the authenticated user's notes, so clients
+// can stop polling. Messages from the client are ignored.
+class NoteSocketController : public drogon::WebSocketController<NoteSocketController>
+{
+public:
+    WS_PATH_LIST_BEGIN
+        WS_PATH_ADD("/notes/ws", "JwtAuthFilter");
+    WS_PATH_LIST_END
+
+    void handleNewConnection(const drogon::HttpRequestPtr& req, const drogon::WebSocketConnectionPtr& conn) override;
+    void handleNewMessage(const drogon::WebSocketConnectionPtr& conn, std::string&& message, const drogon::WebSocketMessageType& type) override;
+    void handleConnectionClosed(const drogon::WebSocketConnectionPtr& conn) override;
+
+private:
+    // Keeps idle connections open through proxies
+    static constexpr std::chrono::seconds pingInterval{30};
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <drogon/orm/DbClient.h>
+#include <drogon/utils/coroutine.h>
+#include <ExpiringCache.hpp>
+
+// Per-user note counts, kept in user_note_stats by the notes_count triggers and
+// served to requests from a node-local cache.
+namespace NoteStats
+{
+    constexpr std::chrono::minutes cacheTtl{5};
+
+    // Counts served to GET /notes/stats, refreshed from user_note_stats on a miss.
+    Utils::ExpiringCache<std::string, int64_t>& cache();
+
+    // Loads the counts of the `hotUsers` largest accounts into the cache.
+    drogon::AsyncTask warmup(drogon::orm::DbClientPtr db, size_t hotUsers, std::function<void()> done);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <drogon/orm/DbClient.h>
+#include <drogon/utils/coroutine.h>
+
+// Per-user change feed for incremental sync. Triggers keep the latest change
+// of every (user, note) pair in note_changes, numbered by a per-user sequence;
+// deletes and lost access are recorded as tombstones.
+namespace NoteSync
+{
+    // Clients that have not synced for longer must start over from seq 0
+    constexpr std::chrono::hours tombstoneRetention{24 * 30};
+    constexpr std::chrono::hours purgeInterval{24};
+
+    // Drops tombstones older than the retention and records, per user, the
+    // highest seq that was dropped.
+    drogon::AsyncTask purgeTombstones(drogon::orm::DbClientPtr db, std::function<void()> done);
+}
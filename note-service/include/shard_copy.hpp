@@ -0,0 +1,24 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <pqxx/pqxx>
+
+// Copying a sharing group of users between shards over blocking libpq
+// connections. Used by note-shard-migrate and by NoteShards::colocate; the
+// caller pins the group `moving:<source>` and waits out the grace period
+// before it copies, and deletes the source rows once the group is pinned to
+// the target.
+namespace ShardCopy
+{
+    // `userId` and everyone connected to it through shared notes, transitively.
+    std::set<std::string> sharingGroup(pqxx::transaction_base& tx, const std::string& userId);
+
+    // Replaces whatever `target` holds for `group` with its rows on `source`, in
+    // one transaction. Throws when the group has grown on `source`, as a share
+    // granted before the pins took effect would leave a member behind.
+    void copy(pqxx::connection& source, pqxx::connection& target, const std::set<std::string>& group);
+
+    // Deletes every row of `group` on `conn`.
+    void remove(pqxx::connection& conn, const std::set<std::string>& group);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Consistent hash ring over shard names. Every shard owns `virtualNodes` points
+// on the ring, so adding a shard moves only about 1/N of the keys. The hash is
+// fixed (not std::hash), so every node and the migration tool agree on it.
+class ShardRing
+{
+public:
+    explicit ShardRing(std::vector<std::string> shards, size_t virtualNodes = 128);
+
+    const std::string& shardFor(std::string_view key) const;
+    const std::vector<std::string>& shards() const { return m_shards; }
+
+    static uint64_t hash(std::string_view key);
+
+private:
+    std::vector<std::string> m_shards;
+    // (point, index into m_shards), sorted by point
+    std::vector<std::pair<uint64_t, size_t>> m_points;
+};
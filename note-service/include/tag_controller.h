@@ -0,0 +1,22 @@
+#pragma once
+
+#include <BaseController.hpp>
+#include <string>
+
+// Personal tags on visible notes. Per-tag note counts live in user_tag_counts
+// and are kept current by a trigger on note_tags.
+class TagController : public BaseController<TagController>
+{
+public:
+    METHOD_LIST_BEGIN
+        ADD_METHOD_TO(TagController::listTags, "/tags", drogon::Get, "JwtAuthFilter");
+        ADD_METHOD_TO(TagController::tagNote, "/notes/{id}/tags/{tag}", drogon::Put, "JwtAuthFilter");
+        ADD_METHOD_TO(TagController::untagNote, "/notes/{id}/tags/{tag}", drogon::Delete, "JwtAuthFilter");
+    METHOD_LIST_END
+
+    drogon::Task<drogon::HttpResponsePtr> listTags(drogon::HttpRequestPtr req);
+    drogon::Task<drogon::HttpResponsePtr> tagNote(drogon::HttpRequestPtr req, std::string noteId, std::string tag);
+    drogon::Task<drogon::HttpResponsePtr> untagNote(drogon::HttpRequestPtr req, std::string noteId, std::string tag);
+
+    static constexpr size_t maxTagLength = 64;
+};
@@ -0,0 +1,9 @@
+--changeset danil:2
+CREATE TABLE user_note_stats
+(
+    user_id VARCHAR(50) PRIMARY KEY,
+    note_count BIGINT NOT NULL,
+    refreshed_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX user_note_stats_note_count_idx ON user_note_stats (note_count DESC);
+--rollback DROP TABLE user_note_stats;
@@ -0,0 +1,16 @@
+--changeset danil:3
+CREATE TYPE note_role AS ENUM ('viewer', 'editor', 'owner');
+CREATE TABLE note_acl
+(
+    user_id VARCHAR(50) NOT NULL,
+    note_id UUID NOT NULL REFERENCES notes(id) ON DELETE CASCADE,
+    role note_role NOT NULL,
+    granted_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (user_id, note_id)
+);
+CREATE INDEX note_acl_note_id_idx ON note_acl (note_id);
+--rollback DROP TABLE note_acl; DROP TYPE note_role;
+
+--changeset danil:4
+INSERT INTO note_acl(user_id, note_id, role) SELECT user_id, id, 'owner' FROM notes;
+--rollback DELETE FROM note_acl WHERE role = 'owner';
@@ -0,0 +1,51 @@
+--changeset danil:5
+CREATE TABLE folders
+(
+    id UUID PRIMARY KEY,
+    user_id VARCHAR(50) NOT NULL,
+    parent_id UUID REFERENCES folders(id) ON DELETE CASCADE,
+    name VARCHAR(255) NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+CREATE INDEX folders_user_id_idx ON folders (user_id, parent_id);
+ALTER TABLE note_acl ADD COLUMN folder_id UUID REFERENCES folders(id) ON DELETE SET NULL;
+CREATE INDEX note_acl_user_folder_idx ON note_acl (user_id, folder_id, note_id);
+--rollback DROP INDEX note_acl_user_folder_idx; ALTER TABLE note_acl DROP COLUMN folder_id; DROP TABLE folders;
+
+--changeset danil:6
+CREATE TABLE note_tags
+(
+    user_id VARCHAR(50) NOT NULL,
+    tag VARCHAR(64) NOT NULL,
+    note_id UUID NOT NULL,
+    PRIMARY KEY (user_id, tag, note_id),
+    FOREIGN KEY (user_id, note_id) REFERENCES note_acl(user_id, note_id) ON DELETE CASCADE
+);
+CREATE INDEX note_tags_note_idx ON note_tags (user_id, note_id);
+CREATE TABLE user_tag_counts
+(
+    user_id VARCHAR(50) NOT NULL,
+    tag VARCHAR(64) NOT NULL,
+    note_count BIGINT NOT NULL,
+    PRIMARY KEY (user_id, tag)
+);
+--rollback DROP TABLE user_tag_counts; DROP TABLE note_tags;
+
+--changeset danil:7 splitStatements:false
+CREATE FUNCTION note_tags_count() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        INSERT INTO user_tag_counts(user_id, tag, note_count) VALUES (NEW.user_id, NEW.tag, 1)
+        ON CONFLICT (user_id, tag) DO UPDATE SET note_count = user_tag_counts.note_count + 1;
+        RETURN NEW;
+    END IF;
+
+    UPDATE user_tag_counts SET note_count = note_count - 1 WHERE user_id = OLD.user_id AND tag = OLD.tag;
+    DELETE FROM user_tag_counts WHERE user_id = OLD.user_id AND tag = OLD.tag AND note_count <= 0;
+    RETURN OLD;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER note_tags_count AFTER INSERT OR DELETE ON note_tags
+FOR EACH ROW EXECUTE FUNCTION note_tags_count();
+--rollback DROP TRIGGER note_tags_count ON note_tags; DROP FUNCTION note_tags_count();
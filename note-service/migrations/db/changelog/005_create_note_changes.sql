@@ -0,0 +1,66 @@
+--changeset danil:8
+CREATE TABLE user_sync_state
+(
+    user_id VARCHAR(50) PRIMARY KEY,
+    last_seq BIGINT NOT NULL DEFAULT 0,
+    purged_seq BIGINT NOT NULL DEFAULT 0
+);
+CREATE TABLE note_changes
+(
+    user_id VARCHAR(50) NOT NULL,
+    note_id UUID NOT NULL,
+    seq BIGINT NOT NULL,
+    deleted BOOLEAN NOT NULL,
+    changed_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (user_id, note_id)
+);
+CREATE UNIQUE INDEX note_changes_user_seq_idx ON note_changes (user_id, seq);
+CREATE INDEX note_changes_tombstones_idx ON note_changes (changed_at) WHERE deleted;
+--rollback DROP TABLE note_changes; DROP TABLE user_sync_state;
+
+--changeset danil:9 splitStatements:false
+-- Only the latest change per (user, note) is kept. The per-user counter row is
+-- locked by the writing transaction, so a user's changes commit in seq order.
+CREATE FUNCTION record_note_change(change_user_id VARCHAR, change_note_id UUID, is_deleted BOOLEAN) RETURNS void AS $$
+DECLARE
+    next_seq BIGINT;
+BEGIN
+    INSERT INTO user_sync_state(user_id, last_seq) VALUES (change_user_id, 1)
+    ON CONFLICT (user_id) DO UPDATE SET last_seq = user_sync_state.last_seq + 1
+    RETURNING last_seq INTO next_seq;
+
+    INSERT INTO note_changes(user_id, note_id, seq, deleted, changed_at)
+    VALUES (change_user_id, change_note_id, next_seq, is_deleted, CURRENT_TIMESTAMP)
+    ON CONFLICT (user_id, note_id) DO UPDATE SET seq = EXCLUDED.seq, deleted = EXCLUDED.deleted, changed_at = EXCLUDED.changed_at;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Deleting a note cascades to note_acl, whose trigger writes the tombstones
+CREATE FUNCTION notes_changed() RETURNS trigger AS $$
+BEGIN
+    PERFORM record_note_change(user_id, note_id, FALSE) FROM note_acl WHERE note_id = NEW.id ORDER BY user_id;
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER notes_changed AFTER UPDATE ON notes
+FOR EACH ROW EXECUTE FUNCTION notes_changed();
+
+CREATE FUNCTION note_acl_changed() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        PERFORM record_note_change(OLD.user_id, OLD.note_id, TRUE);
+        RETURN OLD;
+    END IF;
+    PERFORM record_note_change(NEW.user_id, NEW.note_id, FALSE);
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER note_acl_changed AFTER INSERT OR UPDATE OR DELETE ON note_acl
+FOR EACH ROW EXECUTE FUNCTION note_acl_changed();
+--rollback DROP TRIGGER note_acl_changed ON note_acl; DROP FUNCTION note_acl_changed(); DROP TRIGGER notes_changed ON notes; DROP FUNCTION notes_changed(); DROP FUNCTION record_note_change(VARCHAR, UUID, BOOLEAN);
+
+--changeset danil:10
+SELECT record_note_change(user_id, note_id, FALSE) FROM note_acl ORDER BY user_id, note_id;
+--rollback TRUNCATE note_changes; TRUNCATE user_sync_state;
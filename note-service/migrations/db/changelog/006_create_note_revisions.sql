@@ -0,0 +1,21 @@
+--changeset danil:11
+ALTER TABLE notes ADD COLUMN revision BIGINT NOT NULL DEFAULT 1;
+-- `data` holds the full content for snapshots, otherwise a Utils::Delta against
+-- the previous revision
+CREATE TABLE note_revisions
+(
+    note_id UUID NOT NULL REFERENCES notes(id) ON DELETE CASCADE,
+    revision BIGINT NOT NULL,
+    author_id VARCHAR(50) NOT NULL,
+    title VARCHAR(255) NOT NULL,
+    snapshot BOOLEAN NOT NULL,
+    data BYTEA NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (note_id, revision)
+);
+--rollback DROP TABLE note_revisions; ALTER TABLE notes DROP COLUMN revision;
+
+--changeset danil:12
+INSERT INTO note_revisions(note_id, revision, author_id, title, snapshot, data)
+SELECT id, 1, user_id, title, TRUE, convert_to(content, 'UTF8') FROM notes;
+--rollback DELETE FROM note_revisions WHERE revision = 1;
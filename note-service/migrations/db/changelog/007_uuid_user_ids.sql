@@ -0,0 +1,41 @@
+--changeset danil:13
+-- User ids are the UUIDs issued by auth-service; 16 bytes instead of a 37 byte varlena in every index
+ALTER TABLE note_tags DROP CONSTRAINT note_tags_user_id_note_id_fkey;
+ALTER TABLE notes ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE note_acl ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE note_tags ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE note_tags ADD CONSTRAINT note_tags_user_id_note_id_fkey FOREIGN KEY (user_id, note_id) REFERENCES note_acl(user_id, note_id) ON DELETE CASCADE;
+ALTER TABLE user_tag_counts ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE folders ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE user_note_stats ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE user_sync_state ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE note_changes ALTER COLUMN user_id TYPE UUID USING user_id::uuid;
+ALTER TABLE note_revisions ALTER COLUMN author_id TYPE UUID USING author_id::uuid;
+--rollback ALTER TABLE note_tags DROP CONSTRAINT note_tags_user_id_note_id_fkey;
+--rollback ALTER TABLE notes ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE note_acl ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE note_tags ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE note_tags ADD CONSTRAINT note_tags_user_id_note_id_fkey FOREIGN KEY (user_id, note_id) REFERENCES note_acl(user_id, note_id) ON DELETE CASCADE;
+--rollback ALTER TABLE user_tag_counts ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE folders ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE user_note_stats ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE user_sync_state ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE note_changes ALTER COLUMN user_id TYPE VARCHAR(50);
+--rollback ALTER TABLE note_revisions ALTER COLUMN author_id TYPE VARCHAR(50);
+
+--changeset danil:14 splitStatements:false
+DROP FUNCTION record_note_change(VARCHAR, UUID, BOOLEAN);
+CREATE FUNCTION record_note_change(change_user_id UUID, change_note_id UUID, is_deleted BOOLEAN) RETURNS void AS $$
+DECLARE
+    next_seq BIGINT;
+BEGIN
+    INSERT INTO user_sync_state(user_id, last_seq) VALUES (change_user_id, 1)
+    ON CONFLICT (user_id) DO UPDATE SET last_seq = user_sync_state.last_seq + 1
+    RETURNING last_seq INTO next_seq;
+
+    INSERT INTO note_changes(user_id, note_id, seq, deleted, changed_at)
+    VALUES (change_user_id, change_note_id, next_seq, is_deleted, CURRENT_TIMESTAMP)
+    ON CONFLICT (user_id, note_id) DO UPDATE SET seq = EXCLUDED.seq, deleted = EXCLUDED.deleted, changed_at = EXCLUDED.changed_at;
+END;
+$$ LANGUAGE plpgsql;
+--rollback DROP FUNCTION record_note_change(UUID, UUID, BOOLEAN);
@@ -0,0 +1,46 @@
+--changeset danil:15
+-- A partitioned table's keys must include the partition key, so everything that
+-- points at a note also records its owner
+ALTER TABLE note_acl ADD COLUMN owner_id UUID;
+UPDATE note_acl a SET owner_id = n.user_id FROM notes n WHERE n.id = a.note_id;
+ALTER TABLE note_acl ALTER COLUMN owner_id SET NOT NULL;
+ALTER TABLE note_revisions ADD COLUMN owner_id UUID;
+UPDATE note_revisions r SET owner_id = n.user_id FROM notes n WHERE n.id = r.note_id;
+ALTER TABLE note_revisions ALTER COLUMN owner_id SET NOT NULL;
+--rollback ALTER TABLE note_revisions DROP COLUMN owner_id; ALTER TABLE note_acl DROP COLUMN owner_id;
+
+--changeset danil:16 splitStatements:false
+CREATE TABLE notes_partitioned
+(
+    id UUID NOT NULL,
+    user_id UUID NOT NULL,
+    title VARCHAR(255) NOT NULL,
+    content TEXT NOT NULL,
+    revision BIGINT NOT NULL DEFAULT 1,
+    PRIMARY KEY (user_id, id)
+) PARTITION BY HASH (user_id);
+
+DO $$
+BEGIN
+    FOR i IN 0..31 LOOP
+        EXECUTE format('CREATE TABLE notes_p%s PARTITION OF notes_partitioned FOR VALUES WITH (MODULUS 32, REMAINDER %s)', i, i);
+    END LOOP;
+END;
+$$;
+
+INSERT INTO notes_partitioned(id, user_id, title, content, revision) SELECT id, user_id, title, content, revision FROM notes;
+
+ALTER TABLE note_acl DROP CONSTRAINT note_acl_note_id_fkey;
+ALTER TABLE note_revisions DROP CONSTRAINT note_revisions_note_id_fkey;
+DROP TABLE notes;
+ALTER TABLE notes_partitioned RENAME TO notes;
+ALTER TABLE notes RENAME CONSTRAINT notes_partitioned_pkey TO notes_pkey;
+
+ALTER TABLE note_acl ADD CONSTRAINT note_acl_note_fkey FOREIGN KEY (owner_id, note_id) REFERENCES notes(user_id, id) ON DELETE CASCADE;
+ALTER TABLE note_revisions ADD CONSTRAINT note_revisions_note_fkey FOREIGN KEY (owner_id, note_id) REFERENCES notes(user_id, id) ON DELETE CASCADE;
+CREATE INDEX note_acl_owner_note_idx ON note_acl (owner_id, note_id);
+
+CREATE TRIGGER notes_changed AFTER UPDATE ON notes
+FOR EACH ROW EXECUTE FUNCTION notes_changed();
+-- Not reversible in place; the unpartitioned table has to be restored from a backup
+--rollback empty
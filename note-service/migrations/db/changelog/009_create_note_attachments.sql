@@ -0,0 +1,17 @@
+--changeset danil:17
+-- The bytes live in the blob store under their SHA-256; a row only points at them
+CREATE TABLE note_attachments
+(
+    id UUID PRIMARY KEY,
+    owner_id UUID NOT NULL,
+    note_id UUID NOT NULL,
+    uploader_id UUID NOT NULL,
+    name VARCHAR(255) NOT NULL,
+    sha256 CHAR(64) NOT NULL,
+    size BIGINT NOT NULL,
+    created_at TIMESTAMPTZ NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    FOREIGN KEY (owner_id, note_id) REFERENCES notes(user_id, id) ON DELETE CASCADE
+);
+CREATE INDEX note_attachments_note_idx ON note_attachments (owner_id, note_id);
+CREATE INDEX note_attachments_sha256_idx ON note_attachments (sha256);
+--rollback DROP TABLE note_attachments;
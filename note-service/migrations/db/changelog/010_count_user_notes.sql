@@ -0,0 +1,33 @@
+--changeset danil:18 splitStatements:false
+-- Keeps user_note_stats current on every write instead of recounting notes.
+-- Statement-level, so a bulk import touches each user's row once per statement
+CREATE FUNCTION notes_count() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        INSERT INTO user_note_stats(user_id, note_count, refreshed_at)
+        SELECT user_id, count(*), CURRENT_TIMESTAMP FROM inserted GROUP BY user_id ORDER BY user_id
+        ON CONFLICT (user_id) DO UPDATE SET note_count = user_note_stats.note_count + EXCLUDED.note_count,
+                                            refreshed_at = EXCLUDED.refreshed_at;
+        RETURN NULL;
+    END IF;
+
+    UPDATE user_note_stats s SET note_count = s.note_count - d.note_count, refreshed_at = CURRENT_TIMESTAMP
+    FROM (SELECT user_id, count(*) AS note_count FROM deleted GROUP BY user_id) d
+    WHERE s.user_id = d.user_id;
+    DELETE FROM user_note_stats s USING (SELECT DISTINCT user_id FROM deleted) d
+    WHERE s.user_id = d.user_id AND s.note_count <= 0;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+-- A trigger with transition tables takes a single event
+CREATE TRIGGER notes_count_insert AFTER INSERT ON notes
+REFERENCING NEW TABLE AS inserted FOR EACH STATEMENT EXECUTE FUNCTION notes_count();
+CREATE TRIGGER notes_count_delete AFTER DELETE ON notes
+REFERENCING OLD TABLE AS deleted FOR EACH STATEMENT EXECUTE FUNCTION notes_count();
+
+-- Recount once with writes held off, so no note is counted twice or missed
+LOCK TABLE notes IN SHARE MODE;
+DELETE FROM user_note_stats;
+INSERT INTO user_note_stats(user_id, note_count) SELECT user_id, count(*) FROM notes GROUP BY user_id;
+--rollback DROP TRIGGER notes_count_delete ON notes; DROP TRIGGER notes_count_insert ON notes; DROP FUNCTION notes_count();
@@ -0,0 +1,350 @@
+#include "attachment_controller.h"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <optional>
+#include <drogon/HttpResponse.h>
+#include <drogon/MultiPart.h>
+#include <Coro.hpp>
+#include <ErrorResponses.hpp>
+#include <Uuid.hpp>
+#include "blob_store.hpp"
+#include "note_acl.hpp"
+#include "note_shards.hpp"
+
+drogon::Task<drogon::HttpResponsePtr> AttachmentController::listAttachments(drogon::HttpRequestPtr req, std::string noteId)
+{
+    if (!Utils::Uuid::parse(noteId))
+    {
+        co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+    const auto userId = getUserId(req);
+
+    try
+    {
+        // The outer join keeps the access row when there are no attachments
+        const auto result = co_await NoteShards::forRead(userId)->execSqlCoro
+        (
+            "SELECT t.id, t.name, t.sha256, t.size FROM note_acl a "
+            "LEFT JOIN note_attachments t ON t.owner_id = a.owner_id AND t.note_id = a.note_id "
+            "WHERE a.user_id = $1 AND a.note_id = $2 ORDER BY t.id",
+            userId,
+            noteId
+        );
+        if (result.empty())
+        {
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+
+        Json::Value json = Json::arrayValue;
+        for (const auto& row : result)
+        {
+            if (row["id"].isNull())
+            {
+                continue;
+            }
+            Json::Value attachment;
+            attachment["id"] = row["id"].as<std::string>();
+            attachment["name"] = row["name"].as<std::string>();
+            attachment["sha256"] = row["sha256"].as<std::string>();
+            attachment["size"] = static_cast<Json::Int64>(row["size"].as<int64_t>());
+            json.append(std::move(attachment));
+        }
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> AttachmentController::uploadAttachment(drogon::HttpRequestPtr req, std::string noteId)
+{
+    if (!Utils::Uuid::parse(noteId))
+    {
+        co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+
+    // Large bodies are already in a temporary file; the parts are views into it
+    drogon::MultiPartParser parser;
+    if (parser.parse(req) != 0 || parser.getFiles().size() != 1)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "Expected a multipart body with one file");
+    }
+    const auto& file = parser.getFiles()[0];
+    const auto content = file.fileContent();
+    if (content.size() > maxAttachmentSize)
+    {
+        co_return Utils::errorResponse(Utils::Error::AttachmentTooLarge);
+    }
+    const auto name = safeName(file.getFileName());
+
+    const auto userId = getUserId(req);
+    const auto db = NoteShards::primary(userId);
+
+    try
+    {
+        // Checked before hashing, so nobody without access can make the node write to disk
+        const auto access = co_await db->execSqlCoro("SELECT role::text AS role, owner_id FROM note_acl WHERE user_id = $1 AND note_id = $2", userId, noteId);
+        const auto role = access.empty() ? NoteAcl::Role::None : NoteAcl::fromString(access[0]["role"].as<std::string>()).value_or(NoteAcl::Role::None);
+        if (role < NoteAcl::Role::Editor)
+        {
+            co_return Utils::errorResponse(role == NoteAcl::Role::None ? Utils::Error::NoteNotFound : Utils::Error::Forbidden);
+        }
+        // Attachments are copied with the note's owner
+        if (NoteShards::isMoving(access[0]["owner_id"].as<std::string>()))
+        {
+            co_return Utils::errorResponse(Utils::Error::UserMoving);
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    std::string hash;
+    try
+    {
+        hash = co_await Utils::Coro::runOnWorker([content] { return BlobStore::put(content); });
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::error("Blob store error: {}", ex.what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    try
+    {
+        // Access is checked again, as it may have been revoked during the upload
+        const auto result = co_await db->execSqlCoro
+        (
+            "INSERT INTO note_attachments(id, owner_id, note_id, uploader_id, name, sha256, size) "
+            "SELECT $1, owner_id, note_id, user_id, $4, $5, $6 FROM note_acl "
+            "WHERE user_id = $3 AND note_id = $2 AND role IN ('editor', 'owner') "
+            "RETURNING id",
+            Utils::Uuid::v7().toString(),
+            noteId,
+            userId,
+            name,
+            hash,
+            static_cast<int64_t>(content.size())
+        );
+        if (result.empty())
+        {
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+
+        Json::Value json;
+        json["id"] = result[0]["id"].as<std::string>();
+        json["name"] = name;
+        json["sha256"] = hash;
+        json["size"] = static_cast<Json::Int64>(content.size());
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k201Created);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> AttachmentController::downloadAttachment(drogon::HttpRequestPtr req, std::string noteId, std::string attachmentId)
+{
+    if (!Utils::Uuid::parse(noteId) || !Utils::Uuid::parse(attachmentId))
+    {
+        co_return Utils::errorResponse(Utils::Error::AttachmentNotFound);
+    }
+    const auto userId = getUserId(req);
+
+    std::string name;
+    std::string hash;
+    size_t size = 0;
+    try
+    {
+        const auto result = co_await NoteShards::forRead(userId)->execSqlCoro
+        (
+            "SELECT t.name, t.sha256, t.size FROM note_acl a "
+            "JOIN note_attachments t ON t.owner_id = a.owner_id AND t.note_id = a.note_id "
+            "WHERE a.user_id = $1 AND a.note_id = $2 AND t.id = $3",
+            userId,
+            noteId,
+            attachmentId
+        );
+        if (result.empty())
+        {
+            co_return Utils::errorResponse(Utils::Error::AttachmentNotFound);
+        }
+        name = result[0]["name"].as<std::string>();
+        hash = result[0]["sha256"].as<std::string>();
+        size = static_cast<size_t>(result[0]["size"].as<int64_t>());
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    // Blobs never change, so the hash is a strong validator
+    const auto etag = std::format("\"{}\"", hash);
+    if (req->getHeader("if-none-match") == etag)
+    {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::k304NotModified);
+        resp->addHeader("ETag", etag);
+        co_return resp;
+    }
+
+    const auto path = BlobStore::pathOf(hash);
+    const auto& range = req->getHeader("range");
+    const auto [offset, length] = range.empty() ? std::pair<size_t, size_t>{0, size} : byteRange(range, size);
+    if (length == 0 && size > 0)
+    {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::k416RequestedRangeNotSatisfiable);
+        resp->addHeader("Content-Range", std::format("bytes */{}", size));
+        co_return resp;
+    }
+
+    // File responses go out with sendfile; the content type follows the attachment's name
+    auto resp = offset == 0 && length == size
+        ? drogon::HttpResponse::newFileResponse(path, name)
+        : drogon::HttpResponse::newFileResponse(path, offset, length, true, name);
+    if (resp->statusCode() == drogon::k404NotFound)
+    {
+        spdlog::error("Blob {} of attachment {} is missing", hash, attachmentId);
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+    resp->addHeader("ETag", etag);
+    resp->addHeader("Accept-Ranges", "bytes");
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> AttachmentController::deleteAttachment(drogon::HttpRequestPtr req, std::string noteId, std::string attachmentId)
+{
+    if (!Utils::Uuid::parse(noteId) || !Utils::Uuid::parse(attachmentId))
+    {
+        co_return Utils::errorResponse(Utils::Error::AttachmentNotFound);
+    }
+
+    try
+    {
+        const auto db = NoteShards::primary(getUserId(req));
+        const auto access = co_await db->execSqlCoro("SELECT owner_id FROM note_acl WHERE user_id = $1 AND note_id = $2", getUserId(req), noteId);
+        if (access.empty())
+        {
+            co_return Utils::errorResponse(Utils::Error::AttachmentNotFound);
+        }
+        if (NoteShards::isMoving(access[0]["owner_id"].as<std::string>()))
+        {
+            co_return Utils::errorResponse(Utils::Error::UserMoving);
+        }
+
+        // Only the row goes; the blob may back other attachments
+        const auto result = co_await db->execSqlCoro
+        (
+            "DELETE FROM note_attachments t USING note_acl a "
+            "WHERE a.user_id = $1 AND a.note_id = $2 AND a.role IN ('editor', 'owner') "
+            "AND t.owner_id = a.owner_id AND t.note_id = a.note_id AND t.id = $3",
+            getUserId(req),
+            noteId,
+            attachmentId
+        );
+        if (result.affectedRows() == 0)
+        {
+            co_return Utils::errorResponse(Utils::Error::AttachmentNotFound);
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+std::pair<size_t, size_t> AttachmentController::byteRange(std::string_view header, size_t size)
+{
+    const std::pair<size_t, size_t> whole{0, size};
+    constexpr std::string_view unit = "bytes=";
+    if (!header.starts_with(unit) || header.find(',') != std::string_view::npos)
+    {
+        return whole;
+    }
+    header.remove_prefix(unit.size());
+
+    const auto dash = header.find('-');
+    if (dash == std::string_view::npos)
+    {
+        return whole;
+    }
+    const auto parse = [](std::string_view text) -> std::optional<size_t>
+    {
+        size_t value = 0;
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || ec != std::errc{} || end != text.data() + text.size())
+        {
+            return std::nullopt;
+        }
+        return value;
+    };
+    const auto first = header.substr(0, dash);
+    const auto last = header.substr(dash + 1);
+
+    // bytes=-n: the last n bytes
+    if (first.empty())
+    {
+        const auto suffix = parse(last);
+        if (!suffix)
+        {
+            return whole;
+        }
+        const auto length = std::min(*suffix, size);
+        return {size - length, length};
+    }
+
+    const auto start = parse(first);
+    const auto end = last.empty() ? std::optional<size_t>(size == 0 ? 0 : size - 1) : parse(last);
+    if (!start || !end || *end < *start)
+    {
+        return whole;
+    }
+    if (*start >= size)
+    {
+        return {*start, 0};
+    }
+    return {*start, std::min(*end, size - 1) - *start + 1};
+}
+
+std::string AttachmentController::safeName(std::string_view name)
+{
+    // Browsers send bare names, but some clients include a path
+    if (const auto slash = name.find_last_of("/\\"); slash != std::string_view::npos)
+    {
+        name.remove_prefix(slash + 1);
+    }
+
+    std::string result;
+    size_t characters = 0;
+    for (const auto c : name)
+    {
+        const auto byte = static_cast<unsigned char>(c);
+        // Stop on a character boundary once the column is full
+        if ((byte & 0xC0) != 0x80 && ++characters > maxNameLength)
+        {
+            break;
+        }
+        result += byte < 0x20 || byte == 0x7f || c == '"' ? '_' : c;
+    }
+    return result.empty() ? std::string("attachment") : result;
+}
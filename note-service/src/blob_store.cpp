@@ -0,0 +1,239 @@
+#include "blob_store.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+#include <config.hpp>
+#include <Coro.hpp>
+#include <Utils.hpp>
+#include <Uuid.hpp>
+#include "note_shards.hpp"
+
+namespace BlobStore
+{
+    namespace
+    {
+        void writeFile(const std::filesystem::path& path, std::string_view data)
+        {
+            const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                throw std::runtime_error(std::format("Can not create {}: {}", path.string(), std::strerror(errno)));
+            }
+
+            while (!data.empty())
+            {
+                const auto written = ::write(fd, data.data(), data.size());
+                if (written < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (written < 0)
+                {
+                    const auto error = errno;
+                    ::close(fd);
+                    throw std::runtime_error(std::format("Can not write {}: {}", path.string(), std::strerror(error)));
+                }
+                data.remove_prefix(static_cast<size_t>(written));
+            }
+
+            // The rename must not publish a file whose content is still in the page cache only
+            const bool synced = ::fsync(fd) == 0;
+            ::close(fd);
+            if (!synced)
+            {
+                throw std::runtime_error(std::format("Can not sync {}: {}", path.string(), std::strerror(errno)));
+            }
+        }
+
+        // Hashes are looked up this many at a time
+        constexpr size_t gcBatchSize = 1'000;
+
+        struct Referenced
+        {
+            std::mutex mutex;
+            std::unordered_set<std::string> hashes;
+            bool failed = false;
+        };
+
+        bool idle(const std::filesystem::path& path)
+        {
+            std::error_code error;
+            const auto written = std::filesystem::last_write_time(path, error);
+            return !error && std::filesystem::file_time_type::clock::now() - written > gcGrace;
+        }
+
+        // Hashes of the blobs past the grace period; temporary files left by a
+        // failed upload are removed on the way
+        std::vector<std::string> idleBlobs()
+        {
+            std::vector<std::string> hashes;
+            std::error_code error;
+            for (auto it = std::filesystem::recursive_directory_iterator(Config::noteServiceBlobDir, error);
+                 !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+            {
+                std::error_code skipped;
+                if (!it->is_regular_file(skipped) || !idle(it->path()))
+                {
+                    continue;
+                }
+                auto name = it->path().filename().string();
+                if (name.find(".tmp-") != std::string::npos)
+                {
+                    std::filesystem::remove(it->path(), skipped);
+                }
+                else if (name.size() == 64)
+                {
+                    hashes.push_back(std::move(name));
+                }
+            }
+            return hashes;
+        }
+
+        drogon::AsyncTask findReferenced(drogon::orm::DbClientPtr db, std::shared_ptr<const std::vector<std::string>> hashes,
+                                         std::shared_ptr<Referenced> referenced, std::function<void()> done)
+        {
+            try
+            {
+                for (size_t offset = 0; offset < hashes->size(); offset += gcBatchSize)
+                {
+                    std::string list;
+                    for (size_t i = offset; i < std::min(offset + gcBatchSize, hashes->size()); ++i)
+                    {
+                        list += (list.empty() ? "" : ",") + (*hashes)[i];
+                    }
+                    // The cast to char(64) keeps the lookup on note_attachments_sha256_idx
+                    const auto result = co_await db->execSqlCoro
+                    (
+                        "SELECT DISTINCT sha256 FROM note_attachments WHERE sha256 = ANY(string_to_array($1, ',')::char(64)[])",
+                        list
+                    );
+
+                    std::lock_guard lock(referenced->mutex);
+                    for (const auto& row : result)
+                    {
+                        referenced->hashes.insert(row["sha256"].as<std::string>());
+                    }
+                }
+            }
+            catch (const drogon::orm::DrogonDbException& ex)
+            {
+                spdlog::error("Database error looking up blob references: {}", ex.base().what());
+                std::lock_guard lock(referenced->mutex);
+                referenced->failed = true;
+            }
+            done();
+        }
+
+        drogon::AsyncTask removeUnreferenced(std::shared_ptr<const std::vector<std::string>> hashes, std::shared_ptr<Referenced> referenced, std::function<void()> done)
+        {
+            if (referenced->failed)
+            {
+                spdlog::warn("Skipping blob collection: not every shard answered");
+                done();
+                co_return;
+            }
+
+            try
+            {
+                const auto removed = co_await Utils::Coro::runOnWorker([hashes, referenced]
+                {
+                    size_t removed = 0;
+                    for (const auto& hash : *hashes)
+                    {
+                        // Checked again: an upload that reused the blob since the
+                        // listing touched it, and its row may not be visible yet
+                        const std::filesystem::path path = pathOf(hash);
+                        std::error_code ignored;
+                        if (!referenced->hashes.contains(hash) && idle(path) && std::filesystem::remove(path, ignored))
+                        {
+                            ++removed;
+                        }
+                    }
+                    return removed;
+                });
+                if (removed > 0)
+                {
+                    spdlog::info("Removed {} unreferenced blobs", removed);
+                }
+            }
+            catch (const std::exception& ex)
+            {
+                spdlog::error("Blob collection failed: {}", ex.what());
+            }
+            done();
+        }
+    }//namespace
+
+    std::string pathOf(std::string_view hash)
+    {
+        return (std::filesystem::path(Config::noteServiceBlobDir) / hash.substr(0, 2) / hash).string();
+    }
+
+    std::string put(std::string_view data)
+    {
+        auto hash = Utils::Hash::sha256Hex(data);
+        const std::filesystem::path path = pathOf(hash);
+        // Reusing a blob touches it, so a collection running now keeps it until
+        // this upload's row is committed; if it is already gone, it is written again
+        std::error_code missing;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), missing);
+        if (!missing)
+        {
+            return hash;
+        }
+
+        std::filesystem::create_directories(path.parent_path());
+        auto temporary = path;
+        temporary += ".tmp-" + Utils::Uuid::v7().toString();
+        try
+        {
+            writeFile(temporary, data);
+            // Two uploads of the same bytes may race here; either rename leaves the same content
+            std::filesystem::rename(temporary, path);
+        }
+        catch (...)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            throw;
+        }
+        return hash;
+    }
+
+    drogon::AsyncTask collectGarbage(std::function<void()> done)
+    {
+        std::vector<std::string> hashes;
+        try
+        {
+            hashes = co_await Utils::Coro::runOnWorker([] { return idleBlobs(); });
+        }
+        catch (const std::exception& ex)
+        {
+            spdlog::error("Blob collection failed: {}", ex.what());
+        }
+        if (hashes.empty())
+        {
+            done();
+            co_return;
+        }
+
+        auto candidates = std::make_shared<const std::vector<std::string>>(std::move(hashes));
+        auto referenced = std::make_shared<Referenced>();
+        NoteShards::forEachShard
+        (
+            [candidates, referenced](const auto& db, auto done) { findReferenced(db, candidates, referenced, std::move(done)); },
+            [candidates, referenced, done = std::move(done)] { removeUnreferenced(candidates, referenced, done); }
+        );
+    }
+}
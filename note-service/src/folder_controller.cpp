@@ -0,0 +1,169 @@
+#include "folder_controller.h"
+
+#include <drogon/HttpResponse.h>
+#include <ErrorResponses.hpp>
+#include <Uuid.hpp>
+#include "note_push.hpp"
+#include "note_shards.hpp"
+
+drogon::Task<drogon::HttpResponsePtr> FolderController::listFolders(drogon::HttpRequestPtr req)
+{
+    const auto userId = getUserId(req);
+
+    try
+    {
+        const auto result = co_await NoteShards::forRead(userId)->execSqlCoro
+        (
+            "SELECT id, parent_id, name FROM folders WHERE user_id = $1 ORDER BY name",
+            userId
+        );
+
+        Json::Value json = Json::arrayValue;
+        for (const auto& row : result)
+        {
+            Json::Value folder;
+            folder["id"] = row["id"].as<std::string>();
+            folder["parentId"] = row["parent_id"].isNull() ? Json::Value() : Json::Value(row["parent_id"].as<std::string>());
+            folder["name"] = row["name"].as<std::string>();
+            json.append(std::move(folder));
+        }
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> FolderController::createFolder(drogon::HttpRequestPtr req)
+{
+    const auto json = req->getJsonObject();
+    if (!json)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
+    }
+    if (!(*json)["name"].isString() || (*json)["name"].asString().empty())
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "name is required");
+    }
+    const auto parentId = (*json)["parentId"].isString() ? (*json)["parentId"].asString() : std::string{};
+    if (!parentId.empty() && !Utils::Uuid::parse(parentId))
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "parentId must be a UUID");
+    }
+
+    try
+    {
+        // A parent must belong to the same user
+        const auto result = co_await NoteShards::primary(getUserId(req))->execSqlCoro
+        (
+            "INSERT INTO folders(id, user_id, parent_id, name) "
+            "SELECT $1, $2, NULLIF($3, '')::uuid, $4 "
+            "WHERE $3 = '' OR EXISTS (SELECT 1 FROM folders WHERE id = NULLIF($3, '')::uuid AND user_id = $2) "
+            "RETURNING id",
+            Utils::Uuid::v7().toString(),
+            getUserId(req),
+            parentId,
+            (*json)["name"].asString()
+        );
+        if (result.empty())
+        {
+            co_return Utils::errorResponse(Utils::Error::InvalidBody, "Parent folder does not exist");
+        }
+
+        Json::Value respJson;
+        respJson["id"] = result[0]["id"].as<std::string>();
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(respJson));
+        resp->setStatusCode(drogon::k201Created);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> FolderController::deleteFolder(drogon::HttpRequestPtr req, std::string folderId)
+{
+    if (!Utils::Uuid::parse(folderId))
+    {
+        co_return Utils::errorResponse(Utils::Error::FolderNotFound);
+    }
+
+    try
+    {
+        // Subfolders are removed by cascade; their notes fall back to no folder
+        const auto result = co_await NoteShards::primary(getUserId(req))->execSqlCoro
+        (
+            "DELETE FROM folders WHERE id = $1 AND user_id = $2",
+            folderId,
+            getUserId(req)
+        );
+        if (result.affectedRows() == 0)
+        {
+            co_return Utils::errorResponse(Utils::Error::FolderNotFound);
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> FolderController::moveNote(drogon::HttpRequestPtr req, std::string noteId)
+{
+    if (!Utils::Uuid::parse(noteId))
+    {
+        co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+    const auto json = req->getJsonObject();
+    if (!json)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
+    }
+    // null or a missing folderId takes the note out of its folder
+    const auto folderId = (*json)["folderId"].isString() ? (*json)["folderId"].asString() : std::string{};
+    if (!folderId.empty() && !Utils::Uuid::parse(folderId))
+    {
+        co_return Utils::errorResponse(Utils::Error::FolderNotFound);
+    }
+    const auto userId = getUserId(req);
+
+    try
+    {
+        const auto result = co_await NoteShards::primary(userId)->execSqlCoro
+        (
+            "WITH folder AS (SELECT id FROM folders WHERE id = NULLIF($3, '')::uuid AND user_id = $1) "
+            "UPDATE note_acl SET folder_id = (SELECT id FROM folder) "
+            "WHERE user_id = $1 AND note_id = $2 AND ($3 = '' OR EXISTS (SELECT 1 FROM folder)) "
+            "RETURNING note_id",
+            userId,
+            noteId,
+            folderId
+        );
+        if (result.empty())
+        {
+            co_return Utils::errorResponse(folderId.empty() ? Utils::Error::NoteNotFound : Utils::Error::FolderNotFound);
+        }
+        NotePush::publish(noteId, userId, false);
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
@@ -2,11 +2,27 @@
 #include <config.hpp>
 #include <Utils.hpp>
 #include <JwtAuthFilter.hpp>
+#include <RevocationList.hpp>
+#include <DbRouter.hpp>
+#include <Scheduler.hpp>
+#include "note_stats.hpp"
+#include "note_acl.hpp"
+#include "note_sync.hpp"
+#include "note_push.hpp"
+#include "note_shards.hpp"
+#include "note_autosave.hpp"
+#include "blob_store.hpp"
 //#include <prometheus/exposer.h>
 //#include <prometheus/registry.h>
 //#include <prometheus/counter.h>
 
 
+namespace
+{
+    // Body limit of the routes that are not bulk uploads, drogon's default
+    constexpr size_t maxJsonBodySize = 1024 * 1024;
+}
+
 int main()
 {
     //prometheus::Exposer exposer{"0.0.0.0:9091"};
@@ -16,11 +32,112 @@ int main()
 
     spdlog::set_level(spdlog::level::info);
 
+    if (Config::noteServiceJwksUrl.empty() && !Config::jwtAllowHs256)
+    {
+        spdlog::critical("NOTE_SERVICE_JWKS_URL is not set, so no token could be verified");
+        return 1;
+    }
+    if (!Config::noteServiceJwksUrl.empty())
+    {
+        Utils::Jwt::KeyStore::instance().watchUrl(std::string(Config::noteServiceJwksUrl),
+                                                  std::chrono::seconds{Config::jwtKeysReloadSeconds});
+    }
+
+    Utils::Scheduler scheduler{"note-service"};
+    scheduler.addJob
+    ({
+        .name = "warmup-note-stats",
+        .interval = NoteStats::cacheTtl,
+        .task = [](Utils::Scheduler::Done done)
+        {
+            NoteShards::forEachShard([](const auto& db, auto done) { NoteStats::warmup(db, 10'000, std::move(done)); }, std::move(done));
+        },
+        .leaderOnly = false,
+        .runOnStart = true
+    });
+    scheduler.addJob
+    ({
+        .name = "purge-tombstones",
+        .interval = NoteSync::purgeInterval,
+        .task = [](Utils::Scheduler::Done done)
+        {
+            NoteShards::forEachShard([](const auto& db, auto done) { NoteSync::purgeTombstones(db, std::move(done)); }, std::move(done));
+        }
+    });
+    scheduler.addJob
+    ({
+        .name = "resync-shard-pins",
+        .interval = NoteShards::pinsResyncInterval,
+        .task = [](Utils::Scheduler::Done done) { NoteShards::resync(std::move(done)); },
+        .leaderOnly = false
+    });
+    scheduler.addJob
+    ({
+        .name = "collect-blobs",
+        .interval = BlobStore::gcInterval,
+        .task = [](Utils::Scheduler::Done done) { BlobStore::collectGarbage(std::move(done)); }
+    });
+
     drogon::app()
         .addListener(Config::noteServiceHost.data(), Config::noteServicePort)
         .setThreadNum(std::thread::hardware_concurrency() - 1)
         .loadConfigFile("./note-service-drogon-db-config.json")
+        // Bulk imports are large; bodies past 1 MB are buffered in a temporary file
+        .setClientMaxBodySize(2ull * 1024 * 1024 * 1024)
+        .setClientMaxMemoryBodySize(1024 * 1024)
+        .registerPreRoutingAdvice([](const drogon::HttpRequestPtr& req, drogon::AdviceCallback&& acb, drogon::AdviceChainCallback&& accb)
+        {
+            // Without the shard pins, moved users would be routed to their old shard
+            if (!NoteShards::ready())
+            {
+                acb(Utils::errorResponse(Utils::Error::NotReady));
+                return;
+            }
+
+            // The limit above is for imports and attachment uploads only; every
+            // other route parses its body into a JSON DOM whole
+            const auto path = req->path();
+            const bool bulk = req->method() == drogon::Post &&
+                (path == "/notes/import" || (path.starts_with("/notes/") && path.ends_with("/attachments")));
+            if (!bulk && req->body().size() > maxJsonBodySize)
+            {
+                acb(Utils::errorResponse(Utils::Error::BodyTooLarge));
+                return;
+            }
+            accb();
+        })
         .registerFilter<JwtAuthFilter>(std::make_shared<JwtAuthFilter>())
+        .registerPreHandlingAdvice([](const drogon::HttpRequestPtr& req, drogon::AdviceCallback&& acb, drogon::AdviceChainCallback&& accb)
+        {
+            // Writes of a user whose data is being copied to another shard would be lost
+            if (req->method() != drogon::Get && req->getAttributes()->find("userId") &&
+                NoteShards::isMoving(req->getAttributes()->get<std::string>("userId")))
+            {
+                acb(Utils::errorResponse(Utils::Error::UserMoving));
+                return;
+            }
+            accb();
+        })
+        .registerPostHandlingAdvice([](const drogon::HttpRequestPtr& req, const drogon::HttpResponsePtr& resp)
+        {
+            // Every non-GET route writes; its author reads from the primary for a while
+            if (req->method() != drogon::Get && resp->statusCode() < drogon::k400BadRequest && req->getAttributes()->find("userId"))
+            {
+                Utils::DbRouter::instance().markWritten(req->getAttributes()->get<std::string>("userId"));
+            }
+        })
+        // Staged autosaves are written before the node goes away
+        .setTermSignalHandler([] { drogon::app().getLoop()->queueInLoop([] { NoteAutosave::flushAll([] { drogon::app().quit(); }); }); })
+        .setIntSignalHandler([] { drogon::app().getLoop()->queueInLoop([] { NoteAutosave::flushAll([] { drogon::app().quit(); }); }); })
+        .registerBeginningAdvice([&scheduler]
+        {
+            Utils::RevocationList::instance().start();
+            NoteAcl::start();
+            NotePush::start();
+            NoteShards::start();
+            Utils::DbRouter::instance().start();
+            scheduler.start();
+        })
         .run();
 
     return 0;
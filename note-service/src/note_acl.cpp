@@ -0,0 +1,85 @@
+#include "note_acl.hpp"
+
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <spdlog/spdlog.h>
+
+namespace NoteAcl
+{
+    namespace
+    {
+        void invalidateLocally(std::string_view noteId, std::string_view userId)
+        {
+            if (userId.empty())
+            {
+                const auto prefix = cacheKey(noteId, {});
+                cache().eraseIf([&prefix](const std::string& key) { return key.starts_with(prefix); });
+                return;
+            }
+            cache().erase(cacheKey(noteId, userId));
+        }
+
+        drogon::nosql::RedisSubscriberPtr subscriber;
+    }
+
+    std::string_view toString(Role role)
+    {
+        switch (role)
+        {
+            case Role::Viewer: return "viewer";
+            case Role::Editor: return "editor";
+            case Role::Owner: return "owner";
+            default: return "none";
+        }
+    }
+
+    std::optional<Role> fromString(std::string_view role)
+    {
+        if (role.empty()) return Role::None;
+        if (role == "viewer") return Role::Viewer;
+        if (role == "editor") return Role::Editor;
+        if (role == "owner") return Role::Owner;
+        return std::nullopt;
+    }
+
+    Utils::ExpiringCache<std::string, Role>& cache()
+    {
+        static Utils::ExpiringCache<std::string, Role> cache{100'000};
+        return cache;
+    }
+
+    std::string cacheKey(std::string_view noteId, std::string_view userId)
+    {
+        std::string key;
+        key.reserve(noteId.size() + userId.size() + 1);
+        key.append(noteId).append(":").append(userId);
+        return key;
+    }
+
+    void invalidate(const std::string& noteId, const std::string& userId)
+    {
+        invalidateLocally(noteId, userId);
+
+        drogon::app().getRedisClient()->execCommandAsync
+        (
+            [](const drogon::nosql::RedisResult&) {},
+            [](const std::exception& e) { spdlog::error("Redis error publishing ACL invalidation: {}", e.what()); },
+            "PUBLISH %s %s:%s", channel.data(), noteId.c_str(), userId.c_str()
+        );
+    }
+
+    void start()
+    {
+        subscriber = drogon::app().getRedisClient()->newSubscriber();
+        subscriber->subscribe(std::string(channel), [](const std::string&, const std::string& message)
+        {
+            const auto separator = message.find(':');
+            if (separator == std::string::npos)
+            {
+                spdlog::warn("Malformed ACL invalidation: {}", message);
+                return;
+            }
+            invalidateLocally(std::string_view(message).substr(0, separator), std::string_view(message).substr(separator + 1));
+        });
+    }
+}
@@ -0,0 +1,164 @@
+#include "note_autosave.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <drogon/HttpAppFramework.h>
+#include <spdlog/spdlog.h>
+#include "note_acl.hpp"
+#include "note_history.hpp"
+#include "note_push.hpp"
+#include "note_shards.hpp"
+
+namespace NoteAutosave
+{
+    namespace
+    {
+        struct Edit
+        {
+            std::string userId;
+            std::optional<std::string> title;
+            std::optional<std::string> content;
+            // When the latest change was staged; a revision stored after it wins
+            std::chrono::steady_clock::time_point stagedAt;
+        };
+
+        std::mutex pendingMutex;
+        std::unordered_map<std::string, Edit> pending;
+
+        std::optional<Edit> take(const std::string& noteId)
+        {
+            std::lock_guard lock(pendingMutex);
+            const auto it = pending.find(noteId);
+            if (it == pending.end())
+            {
+                return std::nullopt;
+            }
+            auto edit = std::move(it->second);
+            pending.erase(it);
+            return edit;
+        }
+
+        // Same steps as a direct update; access is checked again, as it may have
+        // been revoked while the edit was staged
+        drogon::Task<> write(std::string noteId, Edit edit)
+        {
+            try
+            {
+                auto tx = co_await NoteShards::primary(edit.userId)->newTransactionCoro();
+                const auto result = co_await NoteHistory::lock(tx, noteId, edit.userId);
+                if (result.empty() || NoteAcl::fromString(result[0]["role"].as<std::string>()).value_or(NoteAcl::Role::None) < NoteAcl::Role::Editor)
+                {
+                    spdlog::warn("Dropping autosave of note {}: {} may no longer edit it", noteId, edit.userId);
+                    co_return;
+                }
+
+                const auto& row = result[0];
+                // Another node may have stored a direct edit since; it is newer, so
+                // it stays. The age is measured here and compared on the database
+                // clock, so the two clocks need not agree.
+                const std::chrono::duration<double> age = std::chrono::steady_clock::now() - edit.stagedAt;
+                const auto newer = co_await tx->execSqlCoro
+                (
+                    "SELECT EXISTS (SELECT 1 FROM note_revisions WHERE note_id = $1 AND revision = $2 "
+                    "AND created_at > clock_timestamp() - make_interval(secs => $3)) AS newer",
+                    noteId,
+                    row["revision"].as<int64_t>(),
+                    age.count()
+                );
+                if (newer[0]["newer"].as<bool>())
+                {
+                    spdlog::warn("Dropping autosave of note {}: revision {} was stored after it", noteId, row["revision"].as<int64_t>());
+                    co_return;
+                }
+
+                auto title = edit.title ? std::move(*edit.title) : row["title"].as<std::string>();
+                auto content = edit.content ? std::move(*edit.content) : row["content"].as<std::string>();
+                co_await NoteHistory::write(tx, noteId, edit.userId, row, std::move(title), std::move(content));
+                NotePush::publish(noteId, row["recipients"].as<std::string>(), false);
+            }
+            catch (const drogon::orm::DrogonDbException& ex)
+            {
+                spdlog::error("Database error saving autosave of note {}: {}", noteId, ex.base().what());
+            }
+        }
+
+        drogon::AsyncTask flushStaged(std::string noteId)
+        {
+            co_await flush(std::move(noteId));
+        }
+
+        drogon::AsyncTask writeCounted(std::string noteId, Edit edit, std::shared_ptr<std::atomic<size_t>> remaining, std::shared_ptr<std::function<void()>> done)
+        {
+            co_await write(std::move(noteId), std::move(edit));
+            if (remaining->fetch_sub(1) == 1)
+            {
+                (*done)();
+            }
+        }
+    }//namespace
+
+    bool stage(const std::string& noteId, const std::string& userId, std::optional<std::string> title, std::optional<std::string> content)
+    {
+        {
+            std::lock_guard lock(pendingMutex);
+            auto it = pending.find(noteId);
+            if (it == pending.end())
+            {
+                if (pending.size() >= maxPending)
+                {
+                    return false;
+                }
+                it = pending.emplace(noteId, Edit{}).first;
+                drogon::app().getLoop()->runAfter(std::chrono::duration<double>(window).count(), [noteId] { flushStaged(noteId); });
+            }
+
+            auto& edit = it->second;
+            edit.userId = userId;
+            edit.stagedAt = std::chrono::steady_clock::now();
+            if (title)
+            {
+                edit.title = std::move(title);
+            }
+            if (content)
+            {
+                edit.content = std::move(content);
+            }
+        }
+        return true;
+    }
+
+    drogon::Task<bool> flush(std::string noteId)
+    {
+        auto edit = take(noteId);
+        if (!edit)
+        {
+            co_return false;
+        }
+        co_await write(std::move(noteId), std::move(*edit));
+        co_return true;
+    }
+
+    void flushAll(std::function<void()> done)
+    {
+        std::unordered_map<std::string, Edit> edits;
+        {
+            std::lock_guard lock(pendingMutex);
+            edits.swap(pending);
+        }
+        if (edits.empty())
+        {
+            done();
+            return;
+        }
+
+        spdlog::info("Flushing {} staged autosaves", edits.size());
+        auto remaining = std::make_shared<std::atomic<size_t>>(edits.size());
+        auto shared = std::make_shared<std::function<void()>>(std::move(done));
+        for (auto& [noteId, edit] : edits)
+        {
+            writeCounted(noteId, std::move(edit), remaining, shared);
+        }
+    }
+}
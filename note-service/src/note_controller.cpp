@@ -1,8 +1,35 @@
 #include "note_controller.h"
 
+#include <charconv>
+#include <limits>
 #include <drogon/HttpResponse.h>
 #include <config.hpp>
 #include <TemplateParser.hpp>
+#include <RequestArena.hpp>
+#include <ErrorResponses.hpp>
+#include <Coro.hpp>
+#include <DbRouter.hpp>
+#include <Uuid.hpp>
+#include <PgPipeline.hpp>
+#include <TextOps.hpp>
+#include "note_stats.hpp"
+#include "note_push.hpp"
+#include "note_history.hpp"
+#include "note_shards.hpp"
+#include "note_import.hpp"
+#include "note_autosave.hpp"
+#include "tag_controller.h"
+
+namespace
+{
+    // A SqlAwaiter only starts the query once awaited; wrapping it in a Task lets
+    // whenAll own and start several of them together.
+    template<typename... Args>
+    drogon::Task<drogon::orm::Result> query(drogon::orm::DbClientPtr db, std::string sql, Args... args)
+    {
+        co_return co_await db->execSqlCoro(sql, std::move(args)...);
+    }
+}//namespace
 
 NoteController::NoteController()
 {
@@ -25,185 +52,1172 @@ NoteController::NoteController()
     }
 }
 
-void NoteController::createNote(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback)
+drogon::Task<drogon::HttpResponsePtr> NoteController::listNotes(drogon::HttpRequestPtr req)
+{
+    // Keyset pagination over the (user_id, note_id) primary key of note_acl
+    const auto after = req->getParameter("after");
+    auto limit = integerParameter(req, "limit", defaultPageSize);
+    if (!limit || *limit == 0)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "limit must be a positive integer");
+    }
+    limit = std::min(*limit, maxPageSize);
+
+    // Optional filters: a personal tag (joined through its (user_id, tag, note_id)
+    // key) and a folder (the (user_id, folder_id, note_id) index on note_acl)
+    const auto tag = req->getParameter("tag");
+    const auto folder = req->getParameter("folder");
+    if ((!after.empty() && !Utils::Uuid::parse(after)) || (!folder.empty() && !Utils::Uuid::parse(folder)))
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "after and folder must be UUIDs");
+    }
+    const auto sql = std::format
+    (
+        "SELECT n.id, n.title, a.role::text AS role FROM note_acl a JOIN notes n ON n.user_id = a.owner_id AND n.id = a.note_id {} "
+        "WHERE a.user_id = $1 AND a.note_id > $2::uuid {} ORDER BY a.note_id LIMIT $3",
+        tag.empty() ? "" : "JOIN note_tags t ON t.user_id = a.user_id AND t.note_id = a.note_id AND t.tag = $4",
+        folder.empty() ? "" : (tag.empty() ? "AND a.folder_id = $4::uuid" : "AND a.folder_id = $5::uuid")
+    );
+
+    const auto userId = getUserId(req);
+    const auto db = NoteShards::forRead(userId);
+    const auto start = after.empty() ? std::string("00000000-0000-0000-0000-000000000000") : after;
+
+    try
+    {
+        std::optional<drogon::orm::Result> rows;
+        if (!tag.empty() && !folder.empty())
+        {
+            rows = co_await db->execSqlCoro(sql, userId, start, *limit, tag, folder);
+        }
+        else if (!tag.empty())
+        {
+            rows = co_await db->execSqlCoro(sql, userId, start, *limit, tag);
+        }
+        else if (!folder.empty())
+        {
+            rows = co_await db->execSqlCoro(sql, userId, start, *limit, folder);
+        }
+        else
+        {
+            rows = co_await db->execSqlCoro(sql, userId, start, *limit);
+        }
+        const auto& result = *rows;
+
+        Json::Value json;
+        json["notes"] = Json::arrayValue;
+        for (const auto& row : result)
+        {
+            Json::Value note;
+            note["id"] = row["id"].as<std::string>();
+            note["title"] = row["title"].as<std::string>();
+            note["role"] = row["role"].as<std::string>();
+            json["notes"].append(std::move(note));
+        }
+        if (static_cast<int64_t>(result.size()) == *limit)
+        {
+            json["next"] = result[result.size() - 1]["id"].as<std::string>();
+        }
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::createNote(drogon::HttpRequestPtr req)
 {
     const auto json = req->getJsonObject();
 
     if (!json)
     {
-        auto resp = drogon::HttpResponse::newHttpResponse();
-        resp->setStatusCode(drogon::k400BadRequest);
-        resp->setBody("Invalid JSON");
-        callback(resp);
-        return;
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
     }
 
-    PostBody body;
+    // Parsed body lives in the request arena and is released together with the request
+    PostBody body{Utils::RequestArena::of(req).allocator<char>()};
     auto error = TemplateParser::parse(*json, body);
     if(error)
     {
-        auto resp = drogon::HttpResponse::newHttpResponse();
-        resp->setStatusCode(drogon::k400BadRequest);
-        resp->setBody(error.fullWhat());
-        callback(resp);
-        return;
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, error.fullWhat());
     }
 
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(callback));
+    auto userId = getUserId(req);
 
-    const auto transaction = drogon::app().getDbClient()->newTransaction();
+    try
+    {
+        // The note, its first revision and its owner entry are written by one statement
+        const auto result = co_await NoteShards::primary(userId)->execSqlCoro
+        (
+            "WITH note AS (INSERT INTO notes(id, user_id, title, content) VALUES($1, $2, $3, $4) RETURNING id), "
+            "revision AS (INSERT INTO note_revisions(note_id, owner_id, revision, author_id, title, snapshot, data) "
+            "SELECT id, $2, 1, $2, $3, TRUE, convert_to($4, 'UTF8') FROM note) "
+            "INSERT INTO note_acl(user_id, note_id, role, owner_id) SELECT $2, id, 'owner', $2 FROM note "
+            "RETURNING note_id",
+            Utils::Uuid::v7().toString(),
+            userId,
+            std::string_view(body.title),
+            std::string_view(body.content)
+        );
 
-    transaction->execSqlAsync
-    (
-        "INSERT INTO notes(id, user_id, title, content) VALUES($1, $2, $3, $4) "
-        "RETURNING id", 
-        [cb](const drogon::orm::Result& result)
-        {
-            Json::Value json;
-            json["id"] = result[0]["id"].as<std::string>();
-            auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
-            resp->setStatusCode(drogon::k201Created);
-            (*cb)(resp);
-        },
-        [cb](const drogon::orm::DrogonDbException& ex)
+        auto noteId = result[0]["note_id"].as<std::string>();
+        NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), NoteAcl::Role::Owner, NoteAcl::cacheTtl);
+        NotePush::publish(noteId, userId, false);
+
+        Json::Value respJson;
+        respJson["id"] = std::move(noteId);
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(respJson));
+        resp->setStatusCode(drogon::k201Created);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::noteStats(drogon::HttpRequestPtr req)
+{
+    auto userId = getUserId(req);
+
+    auto count = NoteStats::cache().get(userId);
+    if (!count)
+    {
+        try
+        {
+            const auto result = co_await NoteShards::primary(userId)->execSqlCoro("SELECT note_count FROM user_note_stats WHERE user_id = $1", userId);
+            count = result.empty() ? 0 : result[0]["note_count"].as<int64_t>();
+            NoteStats::cache().put(userId, *count, NoteStats::cacheTtl);
+        }
+        catch (const drogon::orm::DrogonDbException& ex)
         {
             spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setStatusCode(drogon::k500InternalServerError);
-            resp->setBody("Error creating note");
-            (*cb)(resp);
-        },
-        drogon::utils::getUuid(),
-        getUserId(req),
-        body.title,
-        body.content
-    );
+            co_return Utils::errorResponse(Utils::Error::Internal);
+        }
+    }
+
+    Json::Value json;
+    json["noteCount"] = static_cast<Json::Int64>(*count);
+    auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
 }
 
-void NoteController::readNote(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback, std::string&& noteId)
+drogon::Task<drogon::HttpResponsePtr> NoteController::noteChanges(drogon::HttpRequestPtr req)
 {
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(callback));
-    const auto transaction = drogon::app().getDbClient()->newTransaction();
-    transaction->execSqlAsync
-    (
-        "SELECT user_id, title, content FROM notes WHERE id = $1",
-        [cb, noteId](const drogon::orm::Result& result)
+    const auto since = integerParameter(req, "since", 0);
+    auto limit = integerParameter(req, "limit", maxPageSize);
+    if (!since || !limit || *limit == 0)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "since and limit must be non-negative integers");
+    }
+    limit = std::min(*limit, maxPageSize);
+
+    const auto userId = getUserId(req);
+    const auto db = NoteShards::primary(userId);
+
+    try
+    {
+        // The page and the purge watermark come from one statement, so they see one
+        // snapshot: a purge committed in between can not hide deletes without a 410.
+        // With no changes the page is a single row of NULLs next to the watermark.
+        const auto result = co_await db->execSqlCoro
+        (
+            "SELECT (SELECT purged_seq FROM user_sync_state WHERE user_id = $1) AS purged_seq, p.* FROM (VALUES (1)) AS one "
+            "LEFT JOIN LATERAL (SELECT c.seq, c.note_id, c.deleted, n.title, n.content, a.role::text AS role, a.folder_id "
+            "FROM note_changes c "
+            "LEFT JOIN note_acl a ON NOT c.deleted AND a.user_id = c.user_id AND a.note_id = c.note_id "
+            "LEFT JOIN notes n ON n.user_id = a.owner_id AND n.id = a.note_id "
+            "WHERE c.user_id = $1 AND c.seq > $2 ORDER BY c.seq LIMIT $3) p ON TRUE ORDER BY p.seq",
+            userId,
+            *since,
+            *limit
+        );
+
+        // Tombstones up to purged_seq are gone; an older client would miss deletes
+        if (*since > 0 && !result[0]["purged_seq"].isNull() && *since < result[0]["purged_seq"].as<int64_t>())
+        {
+            co_return Utils::errorResponse(Utils::Error::ResyncRequired);
+        }
+
+        Json::Value json;
+        json["changes"] = Json::arrayValue;
+        int64_t next = *since;
+        int64_t returned = 0;
+        for (const auto& row : result)
         {
-            Json::Value json;
-            if(result.empty())
+            if (row["seq"].isNull())
+            {
+                continue;
+            }
+            ++returned;
+            Json::Value change;
+            next = row["seq"].as<int64_t>();
+            change["seq"] = static_cast<Json::Int64>(next);
+            change["id"] = row["note_id"].as<std::string>();
+            // A note whose access row vanished between trigger and read is reported as deleted
+            if (row["deleted"].as<bool>() || row["title"].isNull())
             {
-                auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k404NotFound);
-                resp->setBody(std::format("Can not find a note with id = {}", noteId));
-                (*cb)(resp);
+                change["deleted"] = true;
             }
+            else
+            {
+                change["title"] = row["title"].as<std::string>();
+                change["content"] = row["content"].as<std::string>();
+                change["role"] = row["role"].as<std::string>();
+                change["folderId"] = row["folder_id"].isNull() ? Json::Value() : Json::Value(row["folder_id"].as<std::string>());
+            }
+            json["changes"].append(std::move(change));
+        }
+        json["next"] = static_cast<Json::Int64>(next);
+        json["hasMore"] = returned == *limit;
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::importNotes(drogon::HttpRequestPtr req)
+{
+    const auto slot = NoteImport::acquireSlot();
+    if (!slot)
+    {
+        co_return Utils::errorResponse(Utils::Error::ImportBusy);
+    }
+
+    const auto userId = getUserId(req);
 
-            const auto& record = result[0];
-            json = TemplateParser::toJson(PostBody::fromSqlRecord(record));
-            auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
-            resp->setStatusCode(drogon::k200OK);
-            (*cb)(resp);
+    try
+    {
+        // COPY runs over a blocking libpq connection of its own, so the import
+        // stays off the event loops; `req` keeps the body alive until it is done
+        const auto report = co_await Utils::Coro::runOnWorker([req, userId, connectionInfo = NoteShards::primary(userId)->connectionInfo()]
+        {
+            return NoteImport::run(connectionInfo, userId, req->body());
+        });
+
+        Json::Value json;
+        json["imported"] = static_cast<Json::UInt64>(report.imported);
+        json["failed"] = static_cast<Json::UInt64>(report.failed);
+        json["errors"] = Json::arrayValue;
+        for (const auto& error : report.errors)
+        {
+            Json::Value entry;
+            entry["line"] = static_cast<Json::UInt64>(error.line);
+            entry["error"] = error.message;
+            json["errors"].append(std::move(entry));
+        }
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::error("Import failed: {}", ex.what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::exportNotes(drogon::HttpRequestPtr req)
+{
+    auto resp = drogon::HttpResponse::newAsyncStreamResponse([userId = getUserId(req)](drogon::ResponseStreamPtr stream)
+    {
+        streamExport(std::move(stream), userId);
+    });
+    resp->setContentTypeString("application/x-ndjson");
+    resp->addHeader("Content-Disposition", "attachment; filename=\"notes.ndjson\"");
+    co_return resp;
+}
+
+drogon::AsyncTask NoteController::streamExport(drogon::ResponseStreamPtr stream, std::string userId)
+{
+    // DECLARE takes no bind parameters, so the id goes into the text; only a
+    // parsed UUID is put there, whatever the token's subject held
+    const auto uuid = Utils::Uuid::parse(userId);
+    if (!uuid)
+    {
+        spdlog::error("Export refused for malformed user id");
+        stream->send("{\"error\":\"internal_error\"}\n");
+        stream->close();
+        co_return;
+    }
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+
+    try
+    {
+        // A cursor keeps one batch in memory however many notes there are; it
+        // lives as long as the transaction. That runs on the primary: on a hot
+        // standby, recovery conflicts cancel long queries, and the largest
+        // exports would fail midway.
+        const auto tx = co_await NoteShards::primary(userId)->newTransactionCoro();
+        co_await tx->execSqlCoro(std::format
+        (
+            "DECLARE note_export NO SCROLL CURSOR FOR "
+            "SELECT n.id, n.title, n.content, n.revision, a.folder_id FROM notes n "
+            "JOIN note_acl a ON a.user_id = n.user_id AND a.note_id = n.id "
+            "WHERE n.user_id = '{}' ORDER BY n.id",
+            uuid->toString()
+        ));
+
+        const auto fetch = std::format("FETCH {} FROM note_export", exportBatchSize);
+        while (true)
+        {
+            const auto rows = co_await tx->execSqlCoro(fetch);
+            if (rows.empty())
+            {
+                break;
+            }
+
+            // Lines have the shape POST /notes/import reads, so an export can be imported again
+            std::string chunk;
+            for (const auto& row : rows)
+            {
+                Json::Value note;
+                note["id"] = row["id"].as<std::string>();
+                note["title"] = row["title"].as<std::string>();
+                note["content"] = row["content"].as<std::string>();
+                note["revision"] = static_cast<Json::Int64>(row["revision"].as<int64_t>());
+                note["folderId"] = row["folder_id"].isNull() ? Json::Value() : Json::Value(row["folder_id"].as<std::string>());
+                chunk += Json::writeString(writer, note);
+                chunk += '\n';
+            }
+            // False once the client has gone; dropping the transaction closes the cursor
+            if (!stream->send(chunk))
+            {
+                co_return;
+            }
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        // The status line is long gone; a last line tells the client the export is incomplete
+        spdlog::error("Database error during export: {}", ex.base().what());
+        stream->send("{\"error\":\"internal_error\"}\n");
+    }
+    stream->close();
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::batchNotes(drogon::HttpRequestPtr req)
+{
+    const auto json = req->getJsonObject();
+    if (!json)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
+    }
+    const auto& operations = (*json)["operations"];
+    if (!operations.isArray() || operations.empty() || operations.size() > maxBatchOperations)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "operations must be a list of 1 to 100 entries");
+    }
+
+    // Each operation is the statement its single-note route runs, with the user
+    // as $1 and the note as $2; all of them travel in one round trip
+    static const std::unordered_map<std::string, std::string> statements
+    {
+        {
+            "tag",
+            "WITH acl AS (SELECT note_id FROM note_acl WHERE user_id = $1 AND note_id = $2), "
+            "tagged AS (INSERT INTO note_tags(user_id, tag, note_id) SELECT $1, $3, note_id FROM acl ON CONFLICT DO NOTHING) "
+            "SELECT EXISTS (SELECT 1 FROM acl) AS done, NULL AS role, NULL AS recipients"
         },
-        [cb](const drogon::orm::DrogonDbException& ex)
         {
-            spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setStatusCode(drogon::k500InternalServerError);
-            resp->setBody("Error creating note");
-            (*cb)(resp);
+            "untag",
+            "WITH removed AS (DELETE FROM note_tags WHERE user_id = $1 AND note_id = $2 AND tag = $3) "
+            "SELECT TRUE AS done, NULL AS role, NULL AS recipients"
         },
-        std::move(noteId)
-    );
+        {
+            "move",
+            "WITH folder AS (SELECT id FROM folders WHERE id = NULLIF($3, '')::uuid AND user_id = $1), "
+            "moved AS (UPDATE note_acl SET folder_id = (SELECT id FROM folder) "
+            "WHERE user_id = $1 AND note_id = $2 AND ($3 = '' OR EXISTS (SELECT 1 FROM folder)) RETURNING note_id) "
+            "SELECT EXISTS (SELECT 1 FROM moved) AS done, NULL AS role, NULL AS recipients"
+        },
+        {
+            "delete",
+            "WITH acl AS (SELECT role FROM note_acl WHERE user_id = $1 AND note_id = $2), "
+            "deleted AS (DELETE FROM notes WHERE user_id = $1 AND id = $2 AND (SELECT role FROM acl) = 'owner' RETURNING id) "
+            "SELECT EXISTS (SELECT 1 FROM deleted) AS done, (SELECT role::text FROM acl) AS role, "
+            "(SELECT string_agg(user_id::text, ',') FROM note_acl WHERE note_id = $2) AS recipients"
+        },
+    };
+
+    const auto userId = getUserId(req);
+    Utils::PgPipeline pipeline(NoteShards::primary(userId)->connectionInfo());
+
+    Json::Value results = Json::arrayValue;
+    std::vector<std::pair<Json::ArrayIndex, size_t>> queued;
+    for (Json::ArrayIndex i = 0; i < operations.size(); ++i)
+    {
+        const auto& operation = operations[i];
+        const auto text = [&operation](const char* field)
+        {
+            return operation.isObject() && operation[field].isString() ? operation[field].asString() : std::string{};
+        };
+        const auto op = text("op");
+        const auto noteId = text("id");
+        const auto argument = text(op == "move" ? "folderId" : "tag");
+        const auto statement = statements.find(op);
+
+        std::optional<Utils::Error> error;
+        if (statement == statements.end())
+        {
+            error = Utils::Error::InvalidBody;
+        }
+        else if (!Utils::Uuid::parse(noteId))
+        {
+            error = Utils::Error::NoteNotFound;
+        }
+        else if (op.ends_with("tag") && (argument.empty() || argument.size() > TagController::maxTagLength))
+        {
+            error = Utils::Error::InvalidBody;
+        }
+        else if (op == "move" && !argument.empty() && !Utils::Uuid::parse(argument))
+        {
+            error = Utils::Error::FolderNotFound;
+        }
+
+        Json::Value result;
+        if (error)
+        {
+            result["status"] = static_cast<int>(Utils::describe(*error).status);
+            result["error"] = std::string(Utils::describe(*error).code);
+        }
+        else
+        {
+            // Parameters the statement does not use would have no type
+            std::vector<std::optional<std::string>> params{userId, noteId};
+            if (op != "delete")
+            {
+                params.emplace_back(argument);
+            }
+            queued.emplace_back(i, pipeline.add(statement->second, std::move(params)));
+        }
+        results.append(std::move(result));
+    }
+
+    try
+    {
+        std::vector<Utils::PgPipeline::Result> rows;
+        if (pipeline.size() > 0)
+        {
+            rows = co_await pipeline.run();
+        }
+        for (const auto& [index, statement] : queued)
+        {
+            const auto& row = rows[statement];
+            const auto& operation = operations[index];
+            // Checked when the operation was queued
+            const auto noteId = Utils::Uuid::parse(operation["id"].asString())->toString();
+            const auto op = operation["op"].asString();
+
+            auto error = std::optional<Utils::Error>{};
+            if (!row.ok())
+            {
+                spdlog::error("Database error in batch: {}", row.error());
+                error = Utils::Error::Internal;
+            }
+            else if (row.get(0, "done") != "t")
+            {
+                // Refusals are told apart the way the single-note routes do it
+                const auto role = NoteAcl::fromString(std::string(row.get(0, "role").value_or(""))).value_or(NoteAcl::Role::None);
+                error = op == "move" && operation["folderId"].isString() && !operation["folderId"].asString().empty() ? Utils::Error::FolderNotFound
+                      : role == NoteAcl::Role::None ? Utils::Error::NoteNotFound : Utils::Error::Forbidden;
+                if (op == "delete")
+                {
+                    NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), role, NoteAcl::cacheTtl);
+                }
+            }
+            else if (op == "delete")
+            {
+                NotePush::publish(noteId, std::string(row.get(0, "recipients").value_or("")), true);
+                NoteAcl::invalidate(noteId);
+            }
+            else if (op == "move")
+            {
+                NotePush::publish(noteId, userId, false);
+            }
+
+            auto& result = results[index];
+            result["status"] = static_cast<int>(error ? Utils::describe(*error).status : drogon::k200OK);
+            if (error)
+            {
+                result["error"] = std::string(Utils::describe(*error).code);
+            }
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::error("Batch pipeline failed: {}", ex.what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    Json::Value respJson;
+    respJson["results"] = std::move(results);
+    auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(respJson));
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+std::optional<int64_t> NoteController::integerParameter(const drogon::HttpRequestPtr& req, const std::string& name, int64_t fallback)
+{
+    const auto& value = req->getParameter(name);
+    if (value.empty())
+    {
+        return fallback;
+    }
+
+    int64_t result = 0;
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc{} || end != value.data() + value.size() || result < 0)
+    {
+        return std::nullopt;
+    }
+    return result;
+}
+
+drogon::Task<std::variant<NoteController::Editable, drogon::HttpResponsePtr>> NoteController::editable(std::string noteId, std::string userId)
+{
+    // A staged autosave goes first, so it can not land on top of this edit later
+    co_await NoteAutosave::flush(noteId);
+
+    // The row lock orders concurrent edits, so every delta is taken against the
+    // revision it follows
+    auto tx = co_await NoteShards::primary(userId)->newTransactionCoro();
+    auto result = co_await NoteHistory::lock(tx, noteId, userId);
+    if (result.empty())
+    {
+        NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), NoteAcl::Role::None, NoteAcl::cacheTtl);
+        co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+    if (NoteAcl::fromString(result[0]["role"].as<std::string>()).value_or(NoteAcl::Role::None) < NoteAcl::Role::Editor)
+    {
+        co_return deniedBy(noteId, userId, result[0]);
+    }
+    // The note is copied with its owner; an edit committed now would be left behind
+    if (NoteShards::isMoving(result[0]["owner_id"].as<std::string>()))
+    {
+        co_return Utils::errorResponse(Utils::Error::UserMoving);
+    }
+    co_return Editable{std::move(tx), std::move(result)};
 }
 
-void NoteController::updateNote(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback, std::string&& noteId)
+std::optional<drogon::HttpResponsePtr> NoteController::denied(std::string& noteId, const std::string& userId, NoteAcl::Role required)
+{
+    // An id that is not a UUID can not name a note; answering here spares the database a cast error
+    const auto uuid = Utils::Uuid::parse(noteId);
+    if (!uuid)
+    {
+        return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+    // Cache keys and invalidations use the canonical spelling, so an upper case
+    // or unhyphenated id can not keep a role alive past its invalidation
+    noteId = uuid->toString();
+
+    const auto role = NoteAcl::cache().get(NoteAcl::cacheKey(noteId, userId));
+    if (!role || *role >= required)
+    {
+        return std::nullopt;
+    }
+    // Without any access the note is reported as missing, so ids can not be probed
+    return Utils::errorResponse(*role == NoteAcl::Role::None ? Utils::Error::NoteNotFound : Utils::Error::Forbidden);
+}
+
+drogon::HttpResponsePtr NoteController::deniedBy(const std::string& noteId, const std::string& userId, const drogon::orm::Row& row)
+{
+    const auto role = NoteAcl::fromString(row["role"].isNull() ? std::string{} : row["role"].as<std::string>()).value_or(NoteAcl::Role::None);
+    NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), role, NoteAcl::cacheTtl);
+    return Utils::errorResponse(role == NoteAcl::Role::None ? Utils::Error::NoteNotFound : Utils::Error::Forbidden);
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::readNote(drogon::HttpRequestPtr req, std::string noteId)
+{
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Viewer))
+    {
+        co_return *resp;
+    }
+    // An edit staged here would otherwise stay invisible for up to the autosave
+    // window; once stored, the replica may not have it yet
+    if (co_await NoteAutosave::flush(noteId))
+    {
+        Utils::DbRouter::instance().markWrittenLocally(userId);
+    }
+    if (NoteAcl::cache().get(NoteAcl::cacheKey(noteId, userId)))
+    {
+        co_return co_await sharedRead(std::move(noteId), std::move(userId));
+    }
+
+    try
+    {
+        // The access check is part of the read: one round trip, one index probe on note_acl
+        const auto result = co_await NoteShards::forRead(userId)->execSqlCoro
+        (
+            "SELECT n.title, n.content, n.revision, a.role::text AS role FROM note_acl a JOIN notes n ON n.user_id = a.owner_id AND n.id = a.note_id "
+            "WHERE a.user_id = $1 AND a.note_id = $2",
+            userId,
+            noteId
+        );
+        if(result.empty())
+        {
+            NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), NoteAcl::Role::None, NoteAcl::cacheTtl);
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+
+        const auto& record = result[0];
+        const auto role = record["role"].as<std::string>();
+        NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), NoteAcl::fromString(role).value_or(NoteAcl::Role::None), NoteAcl::cacheTtl);
+
+        auto json = TemplateParser::toJson(PostBody::fromSqlRecord(record));
+        json["revision"] = static_cast<Json::Int64>(record["revision"].as<int64_t>());
+        json["role"] = role;
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::sharedRead(std::string noteId, std::string userId)
+{
+    // The row is fetched by note alone, so every reader of a popular note joins
+    // one query; it brings the note's access list along, and each reader is
+    // checked against that rather than trusting the cache. Readers sent to the
+    // primary by a recent write get a flight of their own.
+    const auto db = NoteShards::forRead(userId);
+    const auto key = std::format("{}:{}", static_cast<const void*>(db.get()), noteId);
+
+    try
+    {
+        const auto note = co_await m_noteReads.run(key, [db, noteId]() -> drogon::Task<std::shared_ptr<const SharedNote>>
+        {
+            const auto result = co_await db->execSqlCoro
+            (
+                "SELECT n.title, n.content, n.revision, "
+                "(SELECT string_agg(r.user_id::text || ':' || r.role::text, ',') FROM note_acl r WHERE r.owner_id = a.owner_id AND r.note_id = a.note_id) AS roles "
+                "FROM note_acl a JOIN notes n ON n.user_id = a.owner_id AND n.id = a.note_id "
+                "WHERE a.note_id = $1 AND a.role = 'owner'",
+                noteId
+            );
+            if (result.empty())
+            {
+                co_return nullptr;
+            }
+
+            Json::StreamWriterBuilder writer;
+            writer["indentation"] = "";
+            auto json = TemplateParser::toJson(PostBody::fromSqlRecord(result[0]));
+            json["revision"] = static_cast<Json::Int64>(result[0]["revision"].as<int64_t>());
+
+            auto note = std::make_shared<SharedNote>();
+            note->body = Json::writeString(writer, json);
+            note->body.pop_back();
+            // user:role pairs, comma separated
+            const auto roles = result[0]["roles"].as<std::string>();
+            std::string_view rest = roles;
+            while (!rest.empty())
+            {
+                const auto separator = rest.find(',');
+                const auto entry = rest.substr(0, separator);
+                rest = separator == std::string_view::npos ? std::string_view{} : rest.substr(separator + 1);
+
+                const auto colon = entry.find(':');
+                if (const auto role = NoteAcl::fromString(std::string(entry.substr(colon + 1))); role && colon != std::string_view::npos)
+                {
+                    note->roles.emplace(entry.substr(0, colon), *role);
+                }
+            }
+            co_return note;
+        });
+
+        const auto reader = note ? note->roles.find(userId) : std::unordered_map<std::string, NoteAcl::Role>::const_iterator{};
+        const auto role = note && reader != note->roles.end() ? reader->second : NoteAcl::Role::None;
+        NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), role, NoteAcl::cacheTtl);
+        if (role == NoteAcl::Role::None)
+        {
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+
+        // Only the reader's role differs between the fanned out responses
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::k200OK);
+        resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+        resp->setBody(std::format("{},\"role\":\"{}\"}}", note->body, NoteAcl::toString(role)));
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::updateNote(drogon::HttpRequestPtr req, std::string noteId)
 {
-    const auto transaction = drogon::app().getDbClient()->newTransaction();
     const auto json = req->getJsonObject();
     
-    std::string sql = "UPDATE notes SET ";
+    std::string_view column;
     std::string value;
 
-    if (json->getMemberNames().size() > 1)
+    if (!json)
     {
-        auto resp = drogon::HttpResponse::newHttpResponse();
-        resp->setStatusCode(drogon::k400BadRequest);
-        resp->setBody("Can not update more than one parameter at a time");
-        callback(resp);
-        return;
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
+    }
+
+    if (json->isMember("ops"))
+    {
+        co_return co_await patchContent(req, std::move(noteId), *json);
+    }
+
+    if (json->size() > 1)
+    {
+        co_return Utils::errorResponse(Utils::Error::TooManyFields);
     }
 
     if(json->isMember("title"))
     {
-        sql += " title = $1 ";
+        column = "title";
         value = (*json)["title"].as<std::string>();
     }
 
     if(json->isMember("content"))
     {
-        sql += " content = $1 ";
+        column = "content";
         value = (*json)["content"].as<std::string>();
     }
 
-    sql += " WHERE id = $2 RETURNING id";
+    if (column.empty())
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "Expected title or content");
+    }
 
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(callback));
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Editor))
+    {
+        co_return *resp;
+    }
 
-    transaction->execSqlAsync
-    (
-        std::move(sql), 
-        [cb, noteId](const drogon::orm::Result& result)
+    // Autosaves are staged and stored together once the cache confirms the editor;
+    // anyone else takes the direct path, which fills the cache
+    const auto role = NoteAcl::cache().get(NoteAcl::cacheKey(noteId, userId)).value_or(NoteAcl::Role::None);
+    if (req->getParameter("autosave") == "1" && role >= NoteAcl::Role::Editor)
+    {
+        std::optional<std::string> title;
+        std::optional<std::string> content;
+        (column == "title" ? title : content) = value;
+        if (NoteAutosave::stage(noteId, userId, std::move(title), std::move(content)))
         {
-            Json::Value json;
-            if(result.empty())
-            {
-                auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k404NotFound);
-                resp->setBody(std::format("Can not find a note with id = {}", noteId));
-                (*cb)(resp);
-                return;
-            }
             auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setStatusCode(drogon::k200OK);
-            (*cb)(resp);
-        }, 
-        [cb](const drogon::orm::DrogonDbException& ex)
+            resp->setStatusCode(drogon::k202Accepted);
+            co_return resp;
+        }
+    }
+
+    try
+    {
+        auto current = co_await editable(noteId, userId);
+        if (std::holds_alternative<drogon::HttpResponsePtr>(current))
         {
-            spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setStatusCode(drogon::k500InternalServerError);
-            resp->setBody("Error updating note");
-            (*cb)(resp);
-        }, 
-        std::move(value), 
-        std::move(noteId)
-    );
+            co_return std::get<drogon::HttpResponsePtr>(current);
+        }
+        auto& [tx, result] = std::get<Editable>(current);
+        const auto& row = result[0];
+
+        auto title = column == "title" ? std::move(value) : row["title"].as<std::string>();
+        auto content = column == "content" ? std::move(value) : row["content"].as<std::string>();
+        co_await NoteHistory::write(tx, noteId, userId, row, std::move(title), std::move(content));
+        NotePush::publish(noteId, row["recipients"].as<std::string>(), false);
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::patchContent(drogon::HttpRequestPtr req, std::string noteId, Json::Value body)
+{
+    const auto ops = Utils::TextOps::parse(body["ops"]);
+    if (!ops || !body["baseRevision"].isInt64() || body.size() != 2)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "Expected baseRevision and a list of retain, insert and delete ops");
+    }
+    const auto baseRevision = body["baseRevision"].asInt64();
+
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Editor))
+    {
+        co_return *resp;
+    }
+
+    try
+    {
+        auto current = co_await editable(noteId, userId);
+        if (std::holds_alternative<drogon::HttpResponsePtr>(current))
+        {
+            co_return std::get<drogon::HttpResponsePtr>(current);
+        }
+        auto& [tx, result] = std::get<Editable>(current);
+        const auto& row = result[0];
+
+        // Ops address the text the client last saw; against any other revision they would misplace the edit
+        const auto revision = row["revision"].as<int64_t>();
+        if (revision != baseRevision)
+        {
+            co_return Utils::errorResponse(Utils::Error::RevisionConflict, std::format("Note is at revision {}", revision));
+        }
+
+        std::string content;
+        try
+        {
+            content = Utils::TextOps::apply(row["content"].as<std::string_view>(), *ops);
+        }
+        catch (const std::invalid_argument& ex)
+        {
+            co_return Utils::errorResponse(Utils::Error::InvalidBody, ex.what());
+        }
+
+        const auto written = co_await NoteHistory::write(tx, noteId, userId, row, row["title"].as<std::string>(), std::move(content));
+        NotePush::publish(noteId, row["recipients"].as<std::string>(), false);
+
+        Json::Value json;
+        json["revision"] = static_cast<Json::Int64>(written);
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::deleteNote(drogon::HttpRequestPtr req, std::string noteId)
+{
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Owner))
+    {
+        co_return *resp;
+    }
+
+    try
+    {
+        // note_acl rows go with the note through ON DELETE CASCADE; the recipients
+        // subquery still sees them, as it reads the snapshot from before the delete
+        const auto result = co_await NoteShards::primary(userId)->execSqlCoro
+        (
+            "WITH acl AS (SELECT role FROM note_acl WHERE user_id = $2 AND note_id = $1), "
+            "deleted AS (DELETE FROM notes WHERE user_id = $2 AND id = $1 AND (SELECT role FROM acl) = 'owner' RETURNING id) "
+            "SELECT (SELECT role::text FROM acl) AS role, EXISTS (SELECT 1 FROM deleted) AS deleted, "
+            "(SELECT string_agg(user_id::text, ',') FROM note_acl WHERE note_id = $1) AS recipients",
+            noteId,
+            userId
+        );
+        if (!result[0]["deleted"].as<bool>())
+        {
+            co_return deniedBy(noteId, userId, result[0]);
+        }
+        NotePush::publish(noteId, result[0]["recipients"].as<std::string>(), true);
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    NoteAcl::invalidate(noteId);
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
 }
 
-void NoteController::deleteNote(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&callback, std::string &&noteId)
+drogon::Task<drogon::HttpResponsePtr> NoteController::shareNote(drogon::HttpRequestPtr req, std::string noteId, std::string userId)
 {
-    const auto transaction = drogon::app().getDbClient()->newTransaction();
     const auto json = req->getJsonObject();
+    if (!json)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidJson);
+    }
 
-    auto cb = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(callback));
+    // Ownership can not be granted; owners can not be downgraded
+    const auto role = (*json)["role"].isString() ? NoteAcl::fromString((*json)["role"].asString()) : std::nullopt;
+    if (role != NoteAcl::Role::Viewer && role != NoteAcl::Role::Editor)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "role must be viewer or editor");
+    }
 
-    transaction->execSqlAsync
-    (
-        "DELETE FROM notes WHERE id = $1", 
-        [cb, noteId](const drogon::orm::Result& result)
+    const auto grantee = Utils::Uuid::parse(userId);
+    if (!grantee)
+    {
+        co_return Utils::errorResponse(Utils::Error::UserNotFound);
+    }
+    userId = grantee->toString();
+
+    const auto ownerId = getUserId(req);
+    if (auto resp = denied(noteId, ownerId, NoteAcl::Role::Owner))
+    {
+        co_return *resp;
+    }
+    // A grant lives next to the note, so the grantee's own queries only find it
+    // on the owner's shard; a grantee elsewhere is moved there first
+    if (!co_await NoteShards::colocate(userId, ownerId))
+    {
+        co_return Utils::errorResponse(Utils::Error::UserMoving);
+    }
+    // The grantee's group is being copied; a grant now would be left behind on the old shard
+    if (NoteShards::isMoving(userId))
+    {
+        co_return Utils::errorResponse(Utils::Error::UserMoving);
+    }
+
+    try
+    {
+        const auto result = co_await NoteShards::primary(ownerId)->execSqlCoro
+        (
+            "WITH acl AS (SELECT role FROM note_acl WHERE user_id = $2 AND note_id = $1), "
+            "granted AS (INSERT INTO note_acl(user_id, note_id, role, owner_id) SELECT $3, $1, $4::note_role, $2 WHERE (SELECT role FROM acl) = 'owner' "
+            "ON CONFLICT (user_id, note_id) DO UPDATE SET role = EXCLUDED.role, granted_at = CURRENT_TIMESTAMP WHERE note_acl.role <> 'owner' "
+            "RETURNING 1) "
+            "SELECT (SELECT role::text FROM acl) AS role, EXISTS (SELECT 1 FROM granted) AS granted",
+            noteId,
+            ownerId,
+            userId,
+            std::string(NoteAcl::toString(*role))
+        );
+        if (!result[0]["granted"].as<bool>())
         {
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setStatusCode(drogon::k200OK);
-            (*cb)(resp);
-        }, 
-        [cb](const drogon::orm::DrogonDbException& ex)
+            if (result[0]["role"].isNull() || result[0]["role"].as<std::string>() != "owner")
+            {
+                co_return deniedBy(noteId, ownerId, result[0]);
+            }
+            co_return Utils::errorResponse(Utils::Error::InvalidBody, "The owner's role can not be changed");
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    NoteAcl::invalidate(noteId, userId);
+    NotePush::publish(noteId, userId, false);
+    // The grantee did not write, but must not read a replica that lacks the grant
+    Utils::DbRouter::instance().markWritten(userId);
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::unshareNote(drogon::HttpRequestPtr req, std::string noteId, std::string userId)
+{
+    const auto grantee = Utils::Uuid::parse(userId);
+    if (!grantee)
+    {
+        co_return Utils::errorResponse(Utils::Error::UserNotFound);
+    }
+    userId = grantee->toString();
+
+    const auto ownerId = getUserId(req);
+    if (auto resp = denied(noteId, ownerId, NoteAcl::Role::Owner))
+    {
+        co_return *resp;
+    }
+
+    try
+    {
+        const auto result = co_await NoteShards::primary(ownerId)->execSqlCoro
+        (
+            "WITH acl AS (SELECT role FROM note_acl WHERE user_id = $2 AND note_id = $1), "
+            "revoked AS (DELETE FROM note_acl WHERE user_id = $3 AND note_id = $1 AND role <> 'owner' AND (SELECT role FROM acl) = 'owner' RETURNING 1) "
+            "SELECT (SELECT role::text FROM acl) AS role, EXISTS (SELECT 1 FROM revoked) AS revoked",
+            noteId,
+            ownerId,
+            userId
+        );
+        if (result[0]["role"].isNull() || result[0]["role"].as<std::string>() != "owner")
         {
-            spdlog::error("Database error: {}", ex.base().what());
-            auto resp = drogon::HttpResponse::newHttpResponse();
-            resp->setStatusCode(drogon::k500InternalServerError);
-            resp->setBody("Error updating note");
-            (*cb)(resp);
-        }, 
-        std::move(noteId)
-    );
+            co_return deniedBy(noteId, ownerId, result[0]);
+        }
+        if (result[0]["revoked"].as<bool>())
+        {
+            NotePush::publish(noteId, userId, true);
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    NoteAcl::invalidate(noteId, userId);
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::listRevisions(drogon::HttpRequestPtr req, std::string noteId)
+{
+    const auto before = integerParameter(req, "before", std::numeric_limits<int64_t>::max());
+    auto limit = integerParameter(req, "limit", defaultPageSize);
+    if (!before || !limit || *limit == 0)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "before and limit must be positive integers");
+    }
+    limit = std::min(*limit, maxPageSize);
+
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Viewer))
+    {
+        co_return *resp;
+    }
+
+    try
+    {
+        // Every note has its first revision, so an empty first page means no access
+        const auto result = co_await NoteShards::forRead(userId)->execSqlCoro
+        (
+            "SELECT r.revision, r.author_id, extract(epoch FROM r.created_at)::bigint AS created_at "
+            "FROM note_acl a JOIN note_revisions r ON r.note_id = a.note_id "
+            "WHERE a.user_id = $1 AND a.note_id = $2 AND r.revision < $3 ORDER BY r.revision DESC LIMIT $4",
+            userId,
+            noteId,
+            *before,
+            *limit
+        );
+        if (result.empty() && req->getParameter("before").empty())
+        {
+            NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), NoteAcl::Role::None, NoteAcl::cacheTtl);
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+
+        Json::Value json;
+        json["revisions"] = Json::arrayValue;
+        for (const auto& row : result)
+        {
+            Json::Value revision;
+            revision["revision"] = static_cast<Json::Int64>(row["revision"].as<int64_t>());
+            revision["authorId"] = row["author_id"].as<std::string>();
+            revision["createdAt"] = static_cast<Json::Int64>(row["created_at"].as<int64_t>());
+            json["revisions"].append(std::move(revision));
+        }
+        if (static_cast<int64_t>(result.size()) == *limit)
+        {
+            json["next"] = static_cast<Json::Int64>(result[result.size() - 1]["revision"].as<int64_t>());
+        }
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::readRevision(drogon::HttpRequestPtr req, std::string noteId, int64_t revision)
+{
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Viewer))
+    {
+        co_return *resp;
+    }
+
+    try
+    {
+        const auto db = NoteShards::forRead(userId);
+        auto [acl, result] = co_await Utils::Coro::whenAll
+        (
+            query(db, "SELECT role::text AS role FROM note_acl WHERE user_id = $1 AND note_id = $2", userId, noteId),
+            NoteHistory::read(db, noteId, revision)
+        );
+        if (acl.empty())
+        {
+            NoteAcl::cache().put(NoteAcl::cacheKey(noteId, userId), NoteAcl::Role::None, NoteAcl::cacheTtl);
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+        if (!result)
+        {
+            co_return Utils::errorResponse(Utils::Error::RevisionNotFound);
+        }
+
+        Json::Value json;
+        json["revision"] = static_cast<Json::Int64>(result->revision);
+        json["title"] = std::move(result->title);
+        json["content"] = std::move(result->content);
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> NoteController::restoreRevision(drogon::HttpRequestPtr req, std::string noteId, int64_t revision)
+{
+    auto userId = getUserId(req);
+    if (auto resp = denied(noteId, userId, NoteAcl::Role::Editor))
+    {
+        co_return *resp;
+    }
+
+    try
+    {
+        auto current = co_await editable(noteId, userId);
+        if (std::holds_alternative<drogon::HttpResponsePtr>(current))
+        {
+            co_return std::get<drogon::HttpResponsePtr>(current);
+        }
+        auto& [tx, result] = std::get<Editable>(current);
+
+        // Restoring appends the old text as a new revision; history is never rewritten
+        auto restored = co_await NoteHistory::read(tx, noteId, revision);
+        if (!restored)
+        {
+            co_return Utils::errorResponse(Utils::Error::RevisionNotFound);
+        }
+        const auto written = co_await NoteHistory::write(tx, noteId, userId, result[0], std::move(restored->title), std::move(restored->content));
+        NotePush::publish(noteId, result[0]["recipients"].as<std::string>(), false);
+
+        Json::Value json;
+        json["revision"] = static_cast<Json::Int64>(written);
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
 }
@@ -0,0 +1,72 @@
+#include "note_history.hpp"
+
+#include <Delta.hpp>
+
+namespace NoteHistory
+{
+    drogon::Task<drogon::orm::Result> lock(drogon::orm::DbClientPtr tx, std::string noteId, std::string userId)
+    {
+        co_return co_await tx->execSqlCoro
+        (
+            "SELECT a.role::text AS role, a.owner_id, n.title, n.content, n.revision, "
+            "(SELECT string_agg(user_id::text, ',') FROM note_acl WHERE note_id = n.id) AS recipients FROM note_acl a "
+            "JOIN notes n ON n.user_id = a.owner_id AND n.id = a.note_id "
+            "WHERE a.user_id = $2 AND a.note_id = $1 FOR UPDATE OF n",
+            noteId,
+            userId
+        );
+    }
+
+    drogon::Task<int64_t> write(drogon::orm::DbClientPtr tx, std::string noteId, std::string authorId,
+                                const drogon::orm::Row& current, std::string title, std::string content)
+    {
+        const auto revision = current["revision"].as<int64_t>() + 1;
+
+        // A delta that is no smaller than the text buys nothing over a snapshot
+        auto data = Utils::Delta::encode(current["content"].as<std::string>(), content);
+        const bool snapshot = revision % snapshotInterval == 1 || data.size() >= content.size();
+        if (snapshot)
+        {
+            data.assign(content.begin(), content.end());
+        }
+
+        co_await tx->execSqlCoro
+        (
+            "WITH updated AS (UPDATE notes SET title = $3, content = $4, revision = $2 WHERE user_id = $8 AND id = $1) "
+            "INSERT INTO note_revisions(note_id, owner_id, revision, author_id, title, snapshot, data) VALUES ($1, $8, $2, $5, $3, $6, $7)",
+            noteId,
+            revision,
+            title,
+            content,
+            authorId,
+            snapshot,
+            std::move(data),
+            current["owner_id"].as<std::string>()
+        );
+        co_return revision;
+    }
+
+    drogon::Task<std::optional<Revision>> read(drogon::orm::DbClientPtr db, std::string noteId, int64_t revision)
+    {
+        const auto result = co_await db->execSqlCoro
+        (
+            "SELECT revision, title, snapshot, data FROM note_revisions WHERE note_id = $1 AND revision <= $2 "
+            "AND revision >= (SELECT max(revision) FROM note_revisions WHERE note_id = $1 AND revision <= $2 AND snapshot) "
+            "ORDER BY revision",
+            noteId,
+            revision
+        );
+        if (result.empty() || result[result.size() - 1]["revision"].as<int64_t>() != revision)
+        {
+            co_return std::nullopt;
+        }
+
+        std::string content;
+        for (const auto& row : result)
+        {
+            const auto data = row["data"].as<std::vector<char>>();
+            content = row["snapshot"].as<bool>() ? std::string(data.begin(), data.end()) : Utils::Delta::apply(content, data);
+        }
+        co_return Revision{revision, result[result.size() - 1]["title"].as<std::string>(), std::move(content)};
+    }
+}
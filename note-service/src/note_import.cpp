@@ -0,0 +1,179 @@
+#include "note_import.hpp"
+
+#include <atomic>
+#include <format>
+#include <variant>
+#include <json/json.h>
+#include <pqxx/pqxx>
+#include <spdlog/spdlog.h>
+#include <Uuid.hpp>
+
+namespace NoteImport
+{
+    namespace
+    {
+        // notes.title is VARCHAR(255), which counts characters, not bytes
+        constexpr size_t maxTitleLength = 255;
+
+        struct Record
+        {
+            std::string title;
+            std::string content;
+        };
+
+        size_t codePoints(std::string_view text)
+        {
+            size_t count = 0;
+            for (const auto c : text)
+            {
+                count += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+            }
+            return count;
+        }
+
+        std::variant<Record, std::string> parseRecord(Json::CharReader& reader, std::string_view line)
+        {
+            Json::Value value;
+            std::string errors;
+            if (!reader.parse(line.data(), line.data() + line.size(), &value, &errors))
+            {
+                return std::string("Invalid JSON");
+            }
+            if (!value.isObject())
+            {
+                return std::string("Record must be a JSON object");
+            }
+            if (!value["title"].isString() || value["title"].asString().empty())
+            {
+                return std::string("title is required");
+            }
+            if (!value["content"].isNull() && !value["content"].isString())
+            {
+                return std::string("content must be a string");
+            }
+
+            Record record{value["title"].asString(), value["content"].asString()};
+            if (codePoints(record.title) > maxTitleLength)
+            {
+                return std::string("title is longer than 255 characters");
+            }
+            return record;
+        }
+
+        // Reads the next line from `pos`, dropping a trailing CR
+        std::string_view nextLine(std::string_view body, size_t& pos)
+        {
+            auto end = body.find('\n', pos);
+            if (end == std::string_view::npos)
+            {
+                end = body.size();
+            }
+            auto line = body.substr(pos, end - pos);
+            pos = end + 1;
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+            return line;
+        }
+
+        // Streams up to batchSize valid records starting at `pos` and stores them.
+        // `pos`, `line` and `copied` advance as input is consumed, so the caller
+        // can carry on after a failed batch.
+        void importBatch(pqxx::connection& conn, const std::string& userId, std::string_view body, size_t& pos,
+                         size_t& line, size_t& copied, Json::CharReader& reader, Report& report)
+        {
+            pqxx::work tx(conn);
+            tx.exec("CREATE TEMP TABLE note_import(id UUID, title TEXT, content TEXT) ON COMMIT DROP");
+
+            auto stream = pqxx::stream_to::table(tx, {"note_import"});
+            while (copied < batchSize && pos < body.size())
+            {
+                const auto text = nextLine(body, pos);
+                ++line;
+                if (text.find_first_not_of(" \t") == std::string_view::npos)
+                {
+                    continue;
+                }
+
+                auto record = parseRecord(reader, text);
+                if (auto* error = std::get_if<std::string>(&record))
+                {
+                    report.fail(line, std::move(*error));
+                    continue;
+                }
+                const auto& [title, content] = std::get<Record>(record);
+                stream.write_values(Utils::Uuid::v7().toString(), title, content);
+                ++copied;
+            }
+            stream.complete();
+
+            // Same rows as createNote writes, for the whole batch at once
+            tx.exec
+            (
+                "WITH note AS (INSERT INTO notes(id, user_id, title, content) SELECT id, $1, title, content FROM note_import "
+                "RETURNING id, title, content), "
+                "revision AS (INSERT INTO note_revisions(note_id, owner_id, revision, author_id, title, snapshot, data) "
+                "SELECT id, $1, 1, $1, title, TRUE, convert_to(content, 'UTF8') FROM note) "
+                "INSERT INTO note_acl(user_id, note_id, role, owner_id) SELECT $1, id, 'owner', $1 FROM note",
+                pqxx::params{userId}
+            );
+            tx.commit();
+        }
+
+        std::atomic<int> runningImports{0};
+    }//namespace
+
+    void Report::fail(size_t line, std::string message, size_t records)
+    {
+        failed += records;
+        if (errors.size() < maxReportedErrors)
+        {
+            errors.push_back({line, std::move(message)});
+        }
+    }
+
+    std::shared_ptr<void> acquireSlot()
+    {
+        if (runningImports.fetch_add(1) >= maxConcurrentImports)
+        {
+            --runningImports;
+            return nullptr;
+        }
+        // The handle points at the counter, so it tests true while the slot is held
+        return std::shared_ptr<void>(&runningImports, [](std::atomic<int>* running) { --*running; });
+    }
+
+    Report run(const std::string& connectionInfo, const std::string& userId, std::string_view body)
+    {
+        Json::CharReaderBuilder builder;
+        builder["collectComments"] = false;
+        const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+
+        Report report;
+        pqxx::connection conn(connectionInfo);
+
+        size_t pos = 0;
+        size_t line = 0;
+        while (pos < body.size())
+        {
+            const auto firstLine = line + 1;
+            size_t copied = 0;
+            try
+            {
+                importBatch(conn, userId, body, pos, line, copied, *reader, report);
+                report.imported += copied;
+            }
+            catch (const pqxx::broken_connection&)
+            {
+                throw;
+            }
+            catch (const pqxx::sql_error& ex)
+            {
+                spdlog::error("Database error importing lines {}-{}: {}", firstLine, line, ex.what());
+                report.fail(firstLine, std::format("Lines {}-{} were not imported", firstLine, line), copied);
+            }
+        }
+        return report;
+    }
+}
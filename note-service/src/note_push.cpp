@@ -0,0 +1,191 @@
+#include "note_push.hpp"
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <drogon/utils/Utilities.h>
+#include <json/json.h>
+#include <spdlog/spdlog.h>
+#include <trantor/net/EventLoop.h>
+
+namespace NotePush
+{
+    namespace
+    {
+        // Outbox of one connection. Notifications for the same note coalesce
+        // into the latest one until the next flush.
+        struct Session
+        {
+            std::string userId;
+            drogon::WebSocketConnectionPtr conn;
+            trantor::EventLoop* loop;
+
+            std::mutex mutex;
+            std::unordered_map<std::string, bool> pending;
+            bool flushScheduled = false;
+        };
+
+        std::shared_mutex sessionsMutex;
+        std::unordered_multimap<std::string, std::shared_ptr<Session>> sessions;
+
+        // Lets the subscriber skip messages this node already delivered
+        const std::string nodeId = drogon::utils::getUuid();
+        drogon::nosql::RedisSubscriberPtr subscriber;
+
+        void flush(const std::shared_ptr<Session>& session)
+        {
+            std::unordered_map<std::string, bool> batch;
+            {
+                std::lock_guard lock(session->mutex);
+                batch.swap(session->pending);
+                session->flushScheduled = false;
+            }
+            if (batch.empty() || !session->conn->connected())
+            {
+                return;
+            }
+
+            Json::Value json;
+            json["type"] = "changes";
+            json["notes"] = Json::arrayValue;
+            for (auto& [noteId, deleted] : batch)
+            {
+                Json::Value note;
+                note["id"] = noteId;
+                note["deleted"] = deleted;
+                json["notes"].append(std::move(note));
+            }
+
+            static const auto writer = []
+            {
+                Json::StreamWriterBuilder builder;
+                builder["indentation"] = "";
+                return builder;
+            }();
+            session->conn->send(Json::writeString(writer, json));
+        }
+
+        void enqueue(const std::shared_ptr<Session>& session, const std::string& noteId, bool deleted)
+        {
+            bool scheduleFlush = false;
+            bool full = false;
+            {
+                std::lock_guard lock(session->mutex);
+                session->pending.insert_or_assign(noteId, deleted);
+                full = session->pending.size() >= maxBatch;
+                scheduleFlush = !session->flushScheduled;
+                session->flushScheduled = true;
+            }
+
+            // Sends happen on the connection's own loop
+            if (full)
+            {
+                session->loop->queueInLoop([session] { flush(session); });
+            }
+            else if (scheduleFlush)
+            {
+                session->loop->runAfter(std::chrono::duration<double>(batchDelay).count(), [session] { flush(session); });
+            }
+        }
+
+        void deliver(std::string_view noteId, std::string_view recipients, bool deleted)
+        {
+            const std::string note(noteId);
+
+            std::shared_lock lock(sessionsMutex);
+            while (!recipients.empty())
+            {
+                const auto separator = recipients.find(',');
+                const std::string userId(recipients.substr(0, separator));
+                recipients = separator == std::string_view::npos ? std::string_view{} : recipients.substr(separator + 1);
+
+                const auto [begin, end] = sessions.equal_range(userId);
+                for (auto it = begin; it != end; ++it)
+                {
+                    enqueue(it->second, note, deleted);
+                }
+            }
+        }
+    }
+
+    void attach(const std::string& userId, const drogon::WebSocketConnectionPtr& conn)
+    {
+        auto session = std::make_shared<Session>();
+        session->userId = userId;
+        session->conn = conn;
+        session->loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+        conn->setContext(session);
+
+        std::unique_lock lock(sessionsMutex);
+        sessions.emplace(userId, std::move(session));
+    }
+
+    void detach(const drogon::WebSocketConnectionPtr& conn)
+    {
+        const auto session = conn->getContext<Session>();
+        if (!session)
+        {
+            return;
+        }
+        conn->clearContext();
+
+        std::unique_lock lock(sessionsMutex);
+        const auto [begin, end] = sessions.equal_range(session->userId);
+        for (auto it = begin; it != end; ++it)
+        {
+            if (it->second == session)
+            {
+                sessions.erase(it);
+                break;
+            }
+        }
+    }
+
+    void publish(std::string_view noteId, std::string_view recipients, bool deleted)
+    {
+        if (recipients.empty())
+        {
+            return;
+        }
+        deliver(noteId, recipients, deleted);
+
+        const std::string note(noteId);
+        const std::string users(recipients);
+        drogon::app().getRedisClient()->execCommandAsync
+        (
+            [](const drogon::nosql::RedisResult&) {},
+            [](const std::exception& e) { spdlog::error("Redis error publishing note change: {}", e.what()); },
+            "PUBLISH %s %s:%d:%s:%s", channel.data(), nodeId.c_str(), deleted ? 1 : 0, note.c_str(), users.c_str()
+        );
+    }
+
+    void start()
+    {
+        subscriber = drogon::app().getRedisClient()->newSubscriber();
+        subscriber->subscribe(std::string(channel), [](const std::string&, const std::string& message)
+        {
+            // <node>:<deleted>:<note>:<recipients>
+            std::string_view rest(message);
+            std::string_view fields[3];
+            for (auto& field : fields)
+            {
+                const auto separator = rest.find(':');
+                if (separator == std::string_view::npos)
+                {
+                    spdlog::warn("Malformed note change: {}", message);
+                    return;
+                }
+                field = rest.substr(0, separator);
+                rest.remove_prefix(separator + 1);
+            }
+
+            if (fields[0] != nodeId)
+            {
+                deliver(fields[2], rest, fields[1] == "1");
+            }
+        });
+    }
+}
@@ -0,0 +1,400 @@
+#include "note_shards.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <drogon/utils/Utilities.h>
+#include <pqxx/pqxx>
+#include <spdlog/spdlog.h>
+#include <Coro.hpp>
+#include <DbRouter.hpp>
+#include "shard_copy.hpp"
+#include "shard_ring.hpp"
+
+namespace NoteShards
+{
+    namespace
+    {
+        std::optional<ShardRing> ring;
+        // Current and target shards; moved users already live on the latter
+        std::vector<std::string> allShards;
+
+        // An empty value is a removal heard on the channel, kept until a snapshot
+        // taken after it replaces it
+        struct Pin
+        {
+            std::string value;
+            uint64_t seq;
+        };
+
+        std::shared_mutex pinsMutex;
+        std::unordered_map<std::string, Pin> pins;
+        // Bumped by every pin heard on the channel
+        uint64_t pinSeq = 0;
+        std::atomic<bool> loaded{false};
+
+        drogon::nosql::RedisSubscriberPtr subscriber;
+
+        std::vector<std::string> shardList(const Json::Value& config, const char* name)
+        {
+            std::vector<std::string> shards;
+            for (const auto& shard : config[name])
+            {
+                shards.push_back(shard.asString());
+            }
+            if (shards.empty())
+            {
+                shards.emplace_back(Utils::DbRouter::defaultShard);
+            }
+            return shards;
+        }
+
+        // An empty value removes the pin
+        void setPin(const std::string& userId, std::string value)
+        {
+            std::unique_lock lock(pinsMutex);
+            pins.insert_or_assign(userId, Pin{std::move(value), ++pinSeq});
+        }
+
+        std::optional<std::string> pinOf(const std::string& userId)
+        {
+            std::shared_lock lock(pinsMutex);
+            const auto it = pins.find(userId);
+            if (it == pins.end() || it->second.value.empty())
+            {
+                return std::nullopt;
+            }
+            return it->second.value;
+        }
+
+        uint64_t currentSeq()
+        {
+            std::shared_lock lock(pinsMutex);
+            return pinSeq;
+        }
+
+        // Replaces the pins with the hash as HGETALL returned it. Pins heard on the
+        // channel after `since` may be newer than the snapshot, so they stay.
+        size_t applySnapshot(const drogon::nosql::RedisResult& result, uint64_t since)
+        {
+            std::unordered_map<std::string, Pin> snapshot;
+            const auto entries = result.asArray();
+            for (size_t i = 0; i + 1 < entries.size(); i += 2)
+            {
+                snapshot.insert_or_assign(entries[i].asString(), Pin{entries[i + 1].asString(), 0});
+            }
+
+            std::unique_lock lock(pinsMutex);
+            for (auto& [userId, pin] : pins)
+            {
+                if (pin.seq > since)
+                {
+                    snapshot.insert_or_assign(userId, std::move(pin));
+                }
+            }
+            pins.swap(snapshot);
+            loaded = true;
+            return entries.size() / 2;
+        }
+
+        // The replies below are read on a worker: a RedisResult is only valid
+        // inside its callback, which execCommandCoro does not honour
+        drogon::Task<> reload()
+        {
+            const auto since = currentSeq();
+            co_await Utils::Coro::runOnWorker([since]
+            {
+                return drogon::app().getRedisClient()->execCommandSync<size_t>
+                (
+                    [since](const drogon::nosql::RedisResult& result) { return applySnapshot(result, since); },
+                    "HGETALL %s", pinsKey.data()
+                );
+            });
+        }
+
+        drogon::Task<bool> lock(std::string token)
+        {
+            co_return co_await Utils::Coro::runOnWorker([token]
+            {
+                return drogon::app().getRedisClient()->execCommandSync<bool>
+                (
+                    [](const drogon::nosql::RedisResult& result) { return result.type() != drogon::nosql::RedisResultType::kNil; },
+                    "SET %s %s NX EX %lld", moveLockKey.data(), token.c_str(), static_cast<long long>(moveLockTtl.count())
+                );
+            });
+        }
+
+        drogon::Task<> unlock(std::string token)
+        {
+            co_await drogon::app().getRedisClient()->execCommandCoro("EVAL %s 1 %s %s", unlockScript.data(), moveLockKey.data(), token.c_str());
+        }
+
+        // Stores the pin and tells every node, this one at once; an empty value removes it
+        drogon::Task<> publishPin(std::string userId, std::string value)
+        {
+            const auto redis = drogon::app().getRedisClient();
+            if (value.empty())
+            {
+                co_await redis->execCommandCoro("HDEL %s %s", pinsKey.data(), userId.c_str());
+            }
+            else
+            {
+                co_await redis->execCommandCoro("HSET %s %s %s", pinsKey.data(), userId.c_str(), value.c_str());
+            }
+            co_await redis->execCommandCoro("PUBLISH %s %s:%s", pinsKey.data(), userId.c_str(), value.c_str());
+            setPin(userId, std::move(value));
+        }
+
+        // A node that missed the new pins still reads from `from` until its next
+        // resync, so the rows stay until then; the lock is held until they are gone
+        drogon::AsyncTask removeSource(std::set<std::string> group, std::string from, std::string token)
+        {
+            co_await drogon::sleepCoro(trantor::EventLoop::getEventLoopOfCurrentThread(), moveGrace);
+            try
+            {
+                co_await Utils::Coro::runOnWorker([group, connectionInfo = Utils::DbRouter::instance().primary(from)->connectionInfo()]
+                {
+                    pqxx::connection conn(connectionInfo);
+                    ShardCopy::remove(conn, group);
+                });
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::error("Failed to remove the rows of {} left on {}: {}", *group.begin(), from, e.what());
+            }
+
+            try
+            {
+                co_await unlock(token);
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::error("Redis error releasing the shard move lock: {}", e.what());
+            }
+        }
+    }
+
+    void start()
+    {
+        const auto& config = drogon::app().getCustomConfig();
+        ring.emplace(shardList(config, "shards"));
+        allShards = ring->shards();
+        for (auto& shard : shardList(config, "target_shards"))
+        {
+            if (std::find(allShards.begin(), allShards.end(), shard) == allShards.end())
+            {
+                allShards.push_back(std::move(shard));
+            }
+        }
+
+        const auto redis = drogon::app().getRedisClient();
+        subscriber = redis->newSubscriber();
+        subscriber->subscribe(std::string(pinsKey), [](const std::string&, const std::string& message)
+        {
+            // <user>:<pin>, where the pin may itself contain ':'
+            const auto separator = message.find(':');
+            if (separator == std::string::npos)
+            {
+                spdlog::warn("Malformed shard pin: {}", message);
+                return;
+            }
+            setPin(message.substr(0, separator), message.substr(separator + 1));
+        });
+
+        // Routing without the pins would send moved users back to rows that were
+        // deleted, so they are loaded before this returns
+        try
+        {
+            const auto since = currentSeq();
+            const auto count = redis->execCommandSync<size_t>
+            (
+                [since](const drogon::nosql::RedisResult& result) { return applySnapshot(result, since); },
+                "HGETALL %s", pinsKey.data()
+            );
+            spdlog::info("Loaded {} shard pins", count);
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Redis error loading shard pins, requests wait for the next resync: {}", e.what());
+        }
+    }
+
+    void resync(std::function<void()> done)
+    {
+        const auto since = currentSeq();
+        drogon::app().getRedisClient()->execCommandAsync
+        (
+            [since, done](const drogon::nosql::RedisResult& result)
+            {
+                applySnapshot(result, since);
+                done();
+            },
+            [done](const std::exception& e)
+            {
+                spdlog::error("Redis error resyncing shard pins: {}", e.what());
+                done();
+            },
+            "HGETALL %s", pinsKey.data()
+        );
+    }
+
+    bool ready()
+    {
+        return loaded;
+    }
+
+    std::string shardFor(const std::string& userId)
+    {
+        if (auto pin = pinOf(userId))
+        {
+            if (pin->starts_with(movingPrefix))
+            {
+                pin->erase(0, movingPrefix.size());
+            }
+            return std::move(*pin);
+        }
+        return ring->shardFor(userId);
+    }
+
+    bool isMoving(const std::string& userId)
+    {
+        const auto pin = pinOf(userId);
+        return pin && pin->starts_with(movingPrefix);
+    }
+
+    drogon::Task<bool> colocate(std::string userId, std::string hostId)
+    {
+        if (shardFor(userId) == shardFor(hostId))
+        {
+            co_return true;
+        }
+        if (isMoving(userId) || isMoving(hostId))
+        {
+            co_return false;
+        }
+
+        const auto token = drogon::utils::getUuid();
+        try
+        {
+            if (!co_await lock(token))
+            {
+                co_return false;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Redis error taking the shard move lock: {}", e.what());
+            co_return false;
+        }
+
+        std::string from;
+        std::string to;
+        std::set<std::string> group;
+        std::unordered_map<std::string, std::string> previous;
+        bool moved = false;
+        try
+        {
+            // Another move may have finished just before the lock was taken
+            co_await reload();
+            from = shardFor(userId);
+            to = shardFor(hostId);
+            if (from != to && !isMoving(userId) && !isMoving(hostId))
+            {
+                group = co_await Utils::Coro::runOnWorker([userId, connectionInfo = Utils::DbRouter::instance().primary(from)->connectionInfo()]
+                {
+                    pqxx::connection conn(connectionInfo);
+                    pqxx::read_transaction tx(conn);
+                    return ShardCopy::sharingGroup(tx, userId);
+                });
+                const auto stray = std::find_if(group.begin(), group.end(), [&from](const std::string& member) { return shardFor(member) != from; });
+                if (stray != group.end())
+                {
+                    spdlog::warn("Not moving the sharing group of {}: {} lives on {}", userId, *stray, shardFor(*stray));
+                }
+                else
+                {
+                    // Writes are refused from here on, and the grace period lets those
+                    // in flight commit before the copy starts
+                    for (const auto& member : group)
+                    {
+                        previous.emplace(member, pinOf(member).value_or(std::string{}));
+                        co_await publishPin(member, std::string(movingPrefix) + from);
+                    }
+                    co_await drogon::sleepCoro(trantor::EventLoop::getEventLoopOfCurrentThread(), moveGrace);
+
+                    co_await Utils::Coro::runOnWorker([group,
+                                                       source = Utils::DbRouter::instance().primary(from)->connectionInfo(),
+                                                       target = Utils::DbRouter::instance().primary(to)->connectionInfo()]
+                    {
+                        pqxx::connection sourceConn(source);
+                        pqxx::connection targetConn(target);
+                        ShardCopy::copy(sourceConn, targetConn, group);
+                    });
+                    for (const auto& member : group)
+                    {
+                        co_await publishPin(member, to);
+                    }
+                    moved = true;
+                    spdlog::info("Moved the sharing group of {} ({} users) from {} to {}", userId, group.size(), from, to);
+                }
+            }
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Failed to move the sharing group of {} to {}: {}", userId, to, e.what());
+        }
+
+        if (moved)
+        {
+            removeSource(std::move(group), from, token);
+            co_return true;
+        }
+
+        // The rows on `from` are untouched, so the group goes back to them
+        try
+        {
+            for (const auto& [member, pin] : previous)
+            {
+                co_await publishPin(member, pin);
+            }
+            co_await unlock(token);
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Redis error restoring shard pins of {}: {}", userId, e.what());
+        }
+        co_return !from.empty() && from == to;
+    }
+
+    drogon::orm::DbClientPtr primary(const std::string& userId)
+    {
+        return Utils::DbRouter::instance().primary(shardFor(userId));
+    }
+
+    drogon::orm::DbClientPtr forRead(const std::string& userId)
+    {
+        return Utils::DbRouter::instance().forRead(userId, shardFor(userId));
+    }
+
+    void forEachShard(const std::function<void(const drogon::orm::DbClientPtr&, std::function<void()>)>& job, std::function<void()> done)
+    {
+        auto remaining = std::make_shared<std::atomic<size_t>>(allShards.size());
+        for (const auto& shard : allShards)
+        {
+            job(Utils::DbRouter::instance().primary(shard), [remaining, done]
+            {
+                if (remaining->fetch_sub(1) == 1)
+                {
+                    done();
+                }
+            });
+        }
+    }
+}
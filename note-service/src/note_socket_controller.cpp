@@ -0,0 +1,36 @@
+#include "note_socket_controller.h"
+
+#include <trantor/net/EventLoop.h>
+#include <trantor/utils/Date.h>
+#include "note_push.hpp"
+
+void NoteSocketController::handleNewConnection(const drogon::HttpRequestPtr& req, const drogon::WebSocketConnectionPtr& conn)
+{
+    const auto attributes = req->getAttributes();
+    NotePush::attach(attributes->get<std::string>("userId"), conn);
+    conn->setPingMessage("", pingInterval);
+
+    // The socket must not outlive the token that opened it
+    const auto expiresAt = attributes->get<int64_t>("tokenExpiresAt");
+    if (expiresAt > 0)
+    {
+        const auto remaining = std::max<double>(0, expiresAt - trantor::Date::now().secondsSinceEpoch());
+        std::weak_ptr<drogon::WebSocketConnection> weakConn = conn;
+        trantor::EventLoop::getEventLoopOfCurrentThread()->runAfter(remaining, [weakConn]
+        {
+            if (const auto conn = weakConn.lock(); conn && conn->connected())
+            {
+                conn->shutdown(drogon::CloseCode::kViolation, "Token expired");
+            }
+        });
+    }
+}
+
+void NoteSocketController::handleNewMessage(const drogon::WebSocketConnectionPtr&, std::string&&, const drogon::WebSocketMessageType&)
+{
+}
+
+void NoteSocketController::handleConnectionClosed(const drogon::WebSocketConnectionPtr& conn)
+{
+    NotePush::detach(conn);
+}
@@ -0,0 +1,34 @@
+#include "note_stats.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace NoteStats
+{
+    Utils::ExpiringCache<std::string, int64_t>& cache()
+    {
+        static Utils::ExpiringCache<std::string, int64_t> cache{100'000};
+        return cache;
+    }
+
+    drogon::AsyncTask warmup(drogon::orm::DbClientPtr db, size_t hotUsers, std::function<void()> done)
+    {
+        try
+        {
+            const auto result = co_await db->execSqlCoro
+            (
+                "SELECT user_id, note_count FROM user_note_stats ORDER BY note_count DESC LIMIT $1",
+                static_cast<int64_t>(hotUsers)
+            );
+            for (const auto& row : result)
+            {
+                cache().put(row["user_id"].as<std::string>(), row["note_count"].as<int64_t>(), cacheTtl);
+            }
+            spdlog::info("Warmed note stats cache with {} users", result.size());
+        }
+        catch (const drogon::orm::DrogonDbException& ex)
+        {
+            spdlog::error("Error warming note stats cache: {}", ex.base().what());
+        }
+        done();
+    }
+}
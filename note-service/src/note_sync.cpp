@@ -0,0 +1,30 @@
+#include "note_sync.hpp"
+
+#include <format>
+#include <spdlog/spdlog.h>
+
+namespace NoteSync
+{
+    drogon::AsyncTask purgeTombstones(drogon::orm::DbClientPtr db, std::function<void()> done)
+    {
+        static const auto sql = std::format
+        (
+            "WITH purged AS (DELETE FROM note_changes WHERE deleted AND changed_at < CURRENT_TIMESTAMP - INTERVAL '{} hours' "
+            "RETURNING user_id, seq) "
+            "UPDATE user_sync_state s SET purged_seq = GREATEST(s.purged_seq, p.max_seq) "
+            "FROM (SELECT user_id, max(seq) AS max_seq FROM purged GROUP BY user_id) p WHERE s.user_id = p.user_id",
+            tombstoneRetention.count()
+        );
+
+        try
+        {
+            const auto result = co_await db->execSqlCoro(sql);
+            spdlog::info("Purged tombstones of {} users", result.affectedRows());
+        }
+        catch (const drogon::orm::DrogonDbException& ex)
+        {
+            spdlog::error("Error purging tombstones: {}", ex.base().what());
+        }
+        done();
+    }
+}
@@ -0,0 +1,121 @@
+#include "shard_copy.hpp"
+
+#include <format>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace ShardCopy
+{
+    namespace
+    {
+        // Everything stored per user, in insert order; rows are picked by `userColumn`
+        struct Table
+        {
+            std::string_view name;
+            std::string_view userColumn;
+        };
+
+        constexpr Table tables[] =
+        {
+            {"notes", "user_id"},
+            {"note_attachments", "owner_id"},
+            {"note_revisions", "owner_id"},
+            {"folders", "user_id"},
+            {"note_acl", "owner_id"},
+            {"note_tags", "user_id"},
+            {"user_tag_counts", "user_id"},
+            {"user_note_stats", "user_id"},
+            {"user_sync_state", "user_id"},
+            {"note_changes", "user_id"},
+        };
+
+        std::string userList(pqxx::transaction_base& tx, const std::set<std::string>& users)
+        {
+            std::string list;
+            for (const auto& userId : users)
+            {
+                list += list.empty() ? "" : ", ";
+                list += tx.quote(userId);
+            }
+            return list;
+        }
+
+        void copyRows(pqxx::transaction_base& from, pqxx::transaction_base& to, const Table& table, const std::set<std::string>& users)
+        {
+            auto source = pqxx::stream_from::query(from, std::format("SELECT * FROM {} WHERE {} IN ({})", table.name, table.userColumn, userList(from, users)));
+            auto target = pqxx::stream_to::table(to, {table.name});
+
+            // Fields stay in COPY text form, so no column types are needed
+            std::vector<std::optional<std::string_view>> row;
+            while (const auto* fields = source.read_row())
+            {
+                row.clear();
+                for (const auto& field : *fields)
+                {
+                    row.push_back(field.data() == nullptr ? std::nullopt : std::optional<std::string_view>(field));
+                }
+                target.write_row(row);
+            }
+            source.complete();
+            target.complete();
+        }
+
+        void deleteUsers(pqxx::transaction_base& tx, const std::set<std::string>& users)
+        {
+            const auto list = userList(tx, users);
+            for (auto it = std::rbegin(tables); it != std::rend(tables); ++it)
+            {
+                tx.exec(std::format("DELETE FROM {} WHERE {} IN ({})", it->name, it->userColumn, list));
+            }
+        }
+    }//namespace
+
+    std::set<std::string> sharingGroup(pqxx::transaction_base& tx, const std::string& userId)
+    {
+        std::set<std::string> group;
+        const auto rows = tx.query<std::string>
+        (
+            "WITH RECURSIVE edges AS (SELECT owner_id AS a, user_id AS b FROM note_acl WHERE user_id <> owner_id), "
+            "grp(id) AS (SELECT $1::uuid "
+            "UNION SELECT CASE WHEN e.a = g.id THEN e.b ELSE e.a END FROM grp g JOIN edges e ON e.a = g.id OR e.b = g.id) "
+            "SELECT id::text FROM grp",
+            pqxx::params{userId}
+        );
+        for (auto [member] : rows)
+        {
+            group.insert(std::move(member));
+        }
+        return group;
+    }
+
+    void copy(pqxx::connection& source, pqxx::connection& target, const std::set<std::string>& group)
+    {
+        pqxx::work copy(target);
+        // Triggers would record the copied rows as new changes; foreign keys are
+        // satisfied by the end of the copy
+        copy.exec("SET LOCAL session_replication_role = replica");
+        deleteUsers(copy, group);
+
+        pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> read(source);
+        if (sharingGroup(read, *group.begin()) != group)
+        {
+            throw std::runtime_error(std::format("Sharing group of {} changed during the move, run again", *group.begin()));
+        }
+        for (const auto& table : tables)
+        {
+            copyRows(read, copy, table, group);
+        }
+        read.commit();
+        copy.commit();
+    }
+
+    void remove(pqxx::connection& conn, const std::set<std::string>& group)
+    {
+        pqxx::work cleanup(conn);
+        cleanup.exec("SET LOCAL session_replication_role = replica");
+        deleteUsers(cleanup, group);
+        cleanup.commit();
+    }
+}
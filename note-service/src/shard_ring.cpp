@@ -0,0 +1,51 @@
+#include "shard_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+ShardRing::ShardRing(std::vector<std::string> shards, size_t virtualNodes)
+    : m_shards(std::move(shards))
+{
+    if (m_shards.empty())
+    {
+        throw std::invalid_argument("A shard ring needs at least one shard");
+    }
+
+    m_points.reserve(m_shards.size() * virtualNodes);
+    for (size_t shard = 0; shard < m_shards.size(); ++shard)
+    {
+        for (size_t node = 0; node < virtualNodes; ++node)
+        {
+            m_points.emplace_back(hash(m_shards[shard] + "#" + std::to_string(node)), shard);
+        }
+    }
+    std::sort(m_points.begin(), m_points.end());
+}
+
+const std::string& ShardRing::shardFor(std::string_view key) const
+{
+    const auto point = hash(key);
+    auto it = std::lower_bound(m_points.begin(), m_points.end(), std::make_pair(point, size_t{0}));
+    if (it == m_points.end())
+    {
+        it = m_points.begin();
+    }
+    return m_shards[it->second];
+}
+
+uint64_t ShardRing::hash(std::string_view key)
+{
+    // FNV-1a, then a splitmix64 finalizer to spread the short, similar inputs
+    uint64_t x = 0xcbf29ce484222325ULL;
+    for (const auto c : key)
+    {
+        x ^= static_cast<uint8_t>(c);
+        x *= 0x100000001b3ULL;
+    }
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
@@ -0,0 +1,106 @@
+#include "tag_controller.h"
+
+#include <drogon/HttpResponse.h>
+#include <ErrorResponses.hpp>
+#include <Uuid.hpp>
+#include "note_shards.hpp"
+
+drogon::Task<drogon::HttpResponsePtr> TagController::listTags(drogon::HttpRequestPtr req)
+{
+    const auto userId = getUserId(req);
+
+    try
+    {
+        // Counts are maintained on write, so this is a primary key range scan
+        const auto result = co_await NoteShards::forRead(userId)->execSqlCoro
+        (
+            "SELECT tag, note_count FROM user_tag_counts WHERE user_id = $1 ORDER BY tag",
+            userId
+        );
+
+        Json::Value json = Json::arrayValue;
+        for (const auto& row : result)
+        {
+            Json::Value tag;
+            tag["tag"] = row["tag"].as<std::string>();
+            tag["noteCount"] = static_cast<Json::Int64>(row["note_count"].as<int64_t>());
+            json.append(std::move(tag));
+        }
+
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(std::move(json));
+        resp->setStatusCode(drogon::k200OK);
+        co_return resp;
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+}
+
+drogon::Task<drogon::HttpResponsePtr> TagController::tagNote(drogon::HttpRequestPtr req, std::string noteId, std::string tag)
+{
+    if (!Utils::Uuid::parse(noteId))
+    {
+        co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+    if (tag.empty() || tag.size() > maxTagLength)
+    {
+        co_return Utils::errorResponse(Utils::Error::InvalidBody, "tag must be 1 to 64 characters");
+    }
+
+    try
+    {
+        // Any role may tag a note it can see; tagging twice is a no-op
+        const auto result = co_await NoteShards::primary(getUserId(req))->execSqlCoro
+        (
+            "WITH acl AS (SELECT note_id FROM note_acl WHERE user_id = $1 AND note_id = $2), "
+            "tagged AS (INSERT INTO note_tags(user_id, tag, note_id) SELECT $1, $3, note_id FROM acl ON CONFLICT DO NOTHING) "
+            "SELECT EXISTS (SELECT 1 FROM acl) AS visible",
+            getUserId(req),
+            noteId,
+            tag
+        );
+        if (!result[0]["visible"].as<bool>())
+        {
+            co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+        }
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
+
+drogon::Task<drogon::HttpResponsePtr> TagController::untagNote(drogon::HttpRequestPtr req, std::string noteId, std::string tag)
+{
+    if (!Utils::Uuid::parse(noteId))
+    {
+        co_return Utils::errorResponse(Utils::Error::NoteNotFound);
+    }
+
+    try
+    {
+        co_await NoteShards::primary(getUserId(req))->execSqlCoro
+        (
+            "DELETE FROM note_tags WHERE user_id = $1 AND tag = $2 AND note_id = $3",
+            getUserId(req),
+            tag,
+            noteId
+        );
+    }
+    catch (const drogon::orm::DrogonDbException& ex)
+    {
+        spdlog::error("Database error: {}", ex.base().what());
+        co_return Utils::errorResponse(Utils::Error::Internal);
+    }
+
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k200OK);
+    co_return resp;
+}
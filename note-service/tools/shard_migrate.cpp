@@ -0,0 +1,484 @@
+// note-shard-migrate: moves users between note-service shards while the
+// service keeps running. See NoteShards for the placement rules. --user moves
+// that user together with everyone it shares notes with. --clear-pins only
+// runs once `shards` is the target layout.
+//
+// Usage: note-shard-migrate <drogon config> [--user <id>] [--dry-run] [--grace <seconds>]
+//        note-shard-migrate <drogon config> --clear-pins
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <hiredis/hiredis.h>
+#include <json/json.h>
+#include <pqxx/pqxx>
+#include <spdlog/spdlog.h>
+#include "note_shards.hpp"
+#include "shard_copy.hpp"
+#include "shard_ring.hpp"
+
+namespace
+{
+    struct Options
+    {
+        std::string configPath;
+        std::optional<std::string> user;
+        std::chrono::seconds grace = NoteShards::moveGrace;
+        bool dryRun = false;
+        bool clearPins = false;
+    };
+
+    std::string quoteConnectionValue(const std::string& value)
+    {
+        std::string quoted = "'";
+        for (const auto c : value)
+        {
+            if (c == '\'' || c == '\\')
+            {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "'";
+    }
+
+    std::vector<std::string> shardList(const Json::Value& config, const char* name)
+    {
+        std::vector<std::string> shards;
+        for (const auto& shard : config["custom_config"][name])
+        {
+            shards.push_back(shard.asString());
+        }
+        if (shards.empty())
+        {
+            shards.emplace_back("default");
+        }
+        return shards;
+    }
+
+    class Redis
+    {
+    public:
+        explicit Redis(const Json::Value& config)
+        {
+            m_context = redisConnect(config["host"].asCString(), config["port"].asInt());
+            if (m_context == nullptr || m_context->err)
+            {
+                throw std::runtime_error(std::format("Redis connection failed: {}", m_context ? m_context->errstr : "context is not allocated"));
+            }
+            if (!config["passwd"].asString().empty())
+            {
+                freeReplyObject(redisCommand(m_context, "AUTH %s", config["passwd"].asCString()));
+            }
+        }
+
+        ~Redis()
+        {
+            redisFree(m_context);
+        }
+
+        std::map<std::string, std::string> pins()
+        {
+            std::map<std::string, std::string> pins;
+            auto* reply = static_cast<redisReply*>(redisCommand(m_context, "HGETALL %s", NoteShards::pinsKey.data()));
+            if (reply == nullptr)
+            {
+                throw std::runtime_error("Redis error loading shard pins");
+            }
+            for (size_t i = 0; reply->type == REDIS_REPLY_ARRAY && i + 1 < reply->elements; i += 2)
+            {
+                pins.emplace(reply->element[i]->str, reply->element[i + 1]->str);
+            }
+            freeReplyObject(reply);
+            return pins;
+        }
+
+        // Stores the pin and tells every node; an empty value removes it
+        void setPin(const std::string& userId, const std::string& value)
+        {
+            const auto* key = NoteShards::pinsKey.data();
+            freeReplyObject(value.empty()
+                ? redisCommand(m_context, "HDEL %s %s", key, userId.c_str())
+                : redisCommand(m_context, "HSET %s %s %s", key, userId.c_str(), value.c_str()));
+            freeReplyObject(redisCommand(m_context, "PUBLISH %s %s:%s", key, userId.c_str(), value.c_str()));
+        }
+
+        // Waits for the lock nodes take to co-locate users on a share, so no two
+        // copies of one group run at once
+        void lockMoves(const std::string& token)
+        {
+            while (true)
+            {
+                auto* reply = static_cast<redisReply*>(redisCommand(m_context, "SET %s %s NX EX %lld", NoteShards::moveLockKey.data(), token.c_str(),
+                                                                    static_cast<long long>(NoteShards::moveLockTtl.count())));
+                const bool locked = reply != nullptr && reply->type == REDIS_REPLY_STATUS;
+                freeReplyObject(reply);
+                if (locked)
+                {
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::seconds{1});
+            }
+        }
+
+        void unlockMoves(const std::string& token)
+        {
+            freeReplyObject(redisCommand(m_context, "EVAL %s 1 %s %s", NoteShards::unlockScript.data(), NoteShards::moveLockKey.data(), token.c_str()));
+        }
+
+    private:
+        redisContext* m_context;
+    };
+
+    class Migrator
+    {
+    public:
+        Migrator(const Json::Value& config, Options options)
+            : m_options(std::move(options))
+            , m_current(shardList(config, "shards"))
+            , m_target(shardList(config, "target_shards"))
+            , m_redis(config["redis_clients"][0])
+            , m_switched(config["custom_config"]["target_shards"].empty() || m_target.shards() == m_current.shards())
+        {
+            for (const auto& client : config["db_clients"])
+            {
+                m_connections.emplace(client["name"].asString(), std::format
+                (
+                    "host={} port={} dbname={} user={} password={}",
+                    quoteConnectionValue(client["host"].asString()),
+                    client["port"].asInt(),
+                    quoteConnectionValue(client["dbname"].asString()),
+                    quoteConnectionValue(client["user"].asString()),
+                    quoteConnectionValue(client["password"].asString())
+                ));
+            }
+            m_pins = m_redis.pins();
+        }
+
+        // Removes the pins the ring would repeat. Pins of group members placed away
+        // from their own shard stay; they are what keeps those users with their rows.
+        void clearPins()
+        {
+            // Judged against the old ring, a pin to a group's shard could look redundant
+            if (!m_switched)
+            {
+                throw std::runtime_error("target_shards differs from shards; switch shards to the target layout first");
+            }
+            for (const auto& [userId, pin] : m_pins)
+            {
+                if (pin == m_current.shardFor(userId))
+                {
+                    m_redis.setPin(userId, {});
+                }
+            }
+        }
+
+        void run()
+        {
+            std::set<std::string> users;
+            if (m_options.user)
+            {
+                users.insert(*m_options.user);
+            }
+            else
+            {
+                for (const auto& shard : shards())
+                {
+                    pqxx::connection conn(connection(shard));
+                    pqxx::read_transaction tx(conn);
+                    for (auto [userId] : tx.query<std::string>("SELECT user_id::text FROM note_acl UNION SELECT user_id::text FROM folders"))
+                    {
+                        if (locationOf(userId) != shard)
+                        {
+                            spdlog::warn("User {} has rows left on {}, but lives on {}", userId, shard, locationOf(userId));
+                            continue;
+                        }
+                        users.insert(std::move(userId));
+                    }
+                }
+            }
+
+            // A user moves together with everyone it shares notes with, so no
+            // share is ever split across shards, not even during the copy
+            std::set<std::string> done;
+            size_t moved = 0;
+            for (const auto& userId : users)
+            {
+                if (done.contains(userId))
+                {
+                    continue;
+                }
+                const auto from = locationOf(userId);
+                const auto group = sharingGroup(userId, from);
+                done.insert(group.begin(), group.end());
+
+                if (!colocated(group, from))
+                {
+                    pinInPlace(group);
+                    continue;
+                }
+                const auto to = groupTarget(group);
+                if (from == to)
+                {
+                    pinInPlace(group);
+                    continue;
+                }
+
+                spdlog::info("{} {} ({} users) from {} to {}", m_options.dryRun ? "Would move" : "Moving", describe(group), group.size(), from, to);
+                if (!m_options.dryRun)
+                {
+                    move(group, from, to);
+                }
+                moved += group.size();
+            }
+            spdlog::info("{} of {} users {}", moved, done.size(), m_options.dryRun ? "would move" : "moved");
+        }
+
+    private:
+        std::vector<std::string> shards() const
+        {
+            auto shards = m_current.shards();
+            for (const auto& shard : m_target.shards())
+            {
+                if (std::find(shards.begin(), shards.end(), shard) == shards.end())
+                {
+                    shards.push_back(shard);
+                }
+            }
+            return shards;
+        }
+
+        const std::string& connection(const std::string& shard) const
+        {
+            const auto it = m_connections.find(shard);
+            if (it == m_connections.end())
+            {
+                throw std::runtime_error(std::format("Shard {} is not in db_clients", shard));
+            }
+            return it->second;
+        }
+
+        // Where the user's data is now; an interrupted move is resumed from its source
+        std::string locationOf(const std::string& userId) const
+        {
+            const auto it = m_pins.find(userId);
+            if (it == m_pins.end())
+            {
+                return m_current.shardFor(userId);
+            }
+            return it->second.starts_with(NoteShards::movingPrefix) ? it->second.substr(NoteShards::movingPrefix.size()) : it->second;
+        }
+
+        // `userId` and everyone connected to it through shared notes, as `shard` sees it
+        std::set<std::string> sharingGroup(const std::string& userId, const std::string& shard) const
+        {
+            pqxx::connection conn(connection(shard));
+            pqxx::read_transaction tx(conn);
+            return ShardCopy::sharingGroup(tx, userId);
+        }
+
+        // Shares only work within a shard, so a group is moved only when all of it
+        // is on `from`
+        bool colocated(const std::set<std::string>& group, const std::string& from) const
+        {
+            for (const auto& member : group)
+            {
+                if (locationOf(member) != from)
+                {
+                    spdlog::warn("Not moving {}: {} shares notes with it, but lives on {}", describe(group), member, locationOf(member));
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // A group is placed as one: on the target shard most of its members hash
+        // to, the first member's on a tie. The others are pinned there for good.
+        std::string groupTarget(const std::set<std::string>& group) const
+        {
+            std::map<std::string, size_t> votes;
+            std::string best;
+            for (const auto& member : group)
+            {
+                const auto& shard = m_target.shardFor(member);
+                if (++votes[shard] > votes[best])
+                {
+                    best = shard;
+                }
+            }
+            return best;
+        }
+
+        // Pins every member the target ring would send elsewhere to where its rows
+        // are, so switching `shards` to the target layout does not strand it
+        void pinInPlace(const std::set<std::string>& group)
+        {
+            for (const auto& member : group)
+            {
+                const auto location = locationOf(member);
+                if (m_target.shardFor(member) == location || (m_pins.contains(member) && m_pins[member] == location))
+                {
+                    continue;
+                }
+                spdlog::info("{} {} to {}, where its sharing group is", m_options.dryRun ? "Would pin" : "Pinning", member, location);
+                if (!m_options.dryRun)
+                {
+                    m_redis.setPin(member, location);
+                    m_pins[member] = location;
+                }
+            }
+        }
+
+        static std::string describe(const std::set<std::string>& group)
+        {
+            return group.size() == 1 ? *group.begin() : std::format("the sharing group of {}", *group.begin());
+        }
+
+        void move(const std::set<std::string>& group, const std::string& from, const std::string& to)
+        {
+            const auto token = std::format("note-shard-migrate:{}", *group.begin());
+            m_redis.lockMoves(token);
+            // A share may have co-located members elsewhere while the lock was held
+            m_pins = m_redis.pins();
+            if (!colocated(group, from))
+            {
+                m_redis.unlockMoves(token);
+                throw std::runtime_error(std::format("{} changed shards during the move, run again", describe(group)));
+            }
+
+            std::map<std::string, std::string> previous;
+            for (const auto& member : group)
+            {
+                previous[member] = m_pins.contains(member) ? m_pins[member] : std::string{};
+            }
+            const auto restorePins = [&]
+            {
+                for (const auto& [member, pin] : previous)
+                {
+                    m_redis.setPin(member, pin);
+                }
+            };
+
+            // Nodes refuse the group's writes from here on; the grace period lets
+            // writes already in flight commit before the copy starts, and covers
+            // NoteShards::pinsResyncInterval for nodes that missed the message
+            for (const auto& member : group)
+            {
+                m_redis.setPin(member, std::string(NoteShards::movingPrefix) + from);
+            }
+            std::this_thread::sleep_for(m_options.grace);
+
+            try
+            {
+                pqxx::connection source(connection(from));
+                pqxx::connection target(connection(to));
+                ShardCopy::copy(source, target, group);
+            }
+            catch (...)
+            {
+                restorePins();
+                m_redis.unlockMoves(token);
+                throw;
+            }
+
+            for (const auto& member : group)
+            {
+                m_redis.setPin(member, to);
+                m_pins[member] = to;
+            }
+            // A node that missed the message still routes to `from` until its next
+            // resync; its reads must find the rows until then
+            std::this_thread::sleep_for(m_options.grace);
+
+            pqxx::connection source(connection(from));
+            ShardCopy::remove(source, group);
+            m_redis.unlockMoves(token);
+        }
+
+    private:
+        Options m_options;
+        ShardRing m_current;
+        ShardRing m_target;
+        Redis m_redis;
+        std::map<std::string, std::string> m_connections;
+        std::map<std::string, std::string> m_pins;
+        // Whether `shards` already is the target layout
+        bool m_switched;
+    };
+
+    std::optional<Options> parseOptions(int argc, char** argv)
+    {
+        if (argc < 2)
+        {
+            return std::nullopt;
+        }
+
+        Options options;
+        options.configPath = argv[1];
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+            if (arg == "--user" && i + 1 < argc)
+            {
+                options.user = argv[++i];
+            }
+            else if (arg == "--grace" && i + 1 < argc)
+            {
+                options.grace = std::chrono::seconds{std::stoi(argv[++i])};
+            }
+            else if (arg == "--dry-run")
+            {
+                options.dryRun = true;
+            }
+            else if (arg == "--clear-pins")
+            {
+                options.clearPins = true;
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const auto options = parseOptions(argc, argv);
+    if (!options)
+    {
+        spdlog::error("Usage: {} <drogon config> [--user <id>] [--dry-run] [--grace <seconds>] | --clear-pins", argv[0]);
+        return 2;
+    }
+
+    try
+    {
+        Json::Value config;
+        std::ifstream file(options->configPath);
+        file >> config;
+
+        Migrator migrator(config, *options);
+        if (options->clearPins)
+        {
+            migrator.clearPins();
+        }
+        else
+        {
+            migrator.run();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error("Migration failed: {}", e.what());
+        return 1;
+    }
+    return 0;
+}